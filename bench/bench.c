@@ -0,0 +1,225 @@
+// Copyright 2023 Takashi Toyoshima <toyoshim@gmail.com>.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Measures machine cycles that JVSIO_Node_run() takes for standard packets on
+// an MCS-51 simulator. Each packet is fed from the code memory at once, and
+// responses are discarded, so that cycles only for the library and the
+// minimum client code below are counted. Cycles are counted by Timer0 in the
+// mode 1, and overflows are counted by its interrupt.
+//
+// Results are printed via the uCsim simulator interface at xram[0xffff], and
+// the simulation stops at the end.
+
+#include <8051.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "jvsio_client.h"
+#include "jvsio_common.h"
+#include "jvsio_node.h"
+
+struct Packet {
+  const char* name;
+  const uint8_t* data;
+  uint8_t len;
+};
+
+static const uint8_t address_set[] = {0xe0, 0xff, 0x03, 0xf1, 0x01, 0xf4};
+static const uint8_t io_id[] = {0xe0, 0x01, 0x02, 0x10, 0x13};
+static const uint8_t function_check[] = {0xe0, 0x01, 0x02, 0x14, 0x17};
+// SwInput for 2 players and 2 bytes, and CoinInput for 2 slots.
+static const uint8_t poll[] = {0xe0, 0x01, 0x06, 0x20, 0x02,
+                               0x02, 0x21, 0x02, 0x4e};
+static const uint8_t driver_output[] = {0xe0, 0x01, 0x04, 0x32,
+                                        0x01, 0x00, 0x38};
+
+static const struct Packet packets[] = {
+    {"AddressSet", address_set, sizeof(address_set)},
+    {"IoId", io_id, sizeof(io_id)},
+    {"FunctionCheck", function_check, sizeof(function_check)},
+    {"SwInput+CoinInput", poll, sizeof(poll)},
+    {"DriverOutput", driver_output, sizeof(driver_output)},
+};
+
+static __xdata __at(0xffff) volatile uint8_t simif;
+
+static const uint8_t* rx_ptr;
+static uint8_t rx_rest;
+static volatile uint16_t overflows;
+
+void timer0(void) __interrupt(1) {
+  overflows++;
+}
+
+static void putChar(char c) {
+  simif = 'p';
+  simif = c;
+}
+
+// Puts `str` followed by spaces up to `width` columns.
+static void putString(const char* str, uint8_t width) {
+  uint8_t size = 0;
+  for (; *str; ++size)
+    putChar(*str++);
+  for (; size < width; ++size)
+    putChar(' ');
+}
+
+// Puts `value` in decimal aligned to the right in `width` columns.
+static void putNumber(uint32_t value, uint8_t width) {
+  char digits[10];
+  uint8_t size = 0;
+  do {
+    digits[size++] = '0' + value % 10;
+    value /= 10;
+  } while (value);
+  for (; width > size; --width)
+    putChar(' ');
+  while (size)
+    putChar(digits[--size]);
+}
+
+static void startTimer(void) {
+  TR0 = 0;
+  TH0 = 0;
+  TL0 = 0;
+  TF0 = 0;
+  overflows = 0;
+  TR0 = 1;
+}
+
+static uint32_t stopTimer(void) {
+  TR0 = 0;
+  if (TF0) {
+    // The last overflow may not be serviced by the interrupt yet.
+    TF0 = 0;
+    overflows++;
+  }
+  return ((uint32_t)overflows << 16) | ((uint16_t)TH0 << 8) | TL0;
+}
+
+static uint32_t measure(const struct Packet* packet, bool speculative) {
+  rx_ptr = packet->data;
+  rx_rest = packet->len;
+  startTimer();
+  // The speculative mode may return before the whole packet is handled, e.g.
+  // to verify AddressSet. Count all runs until the response is sent.
+  do {
+    JVSIO_Node_run(speculative);
+  } while (rx_rest || JVSIO_Node_isBusy());
+  return stopTimer();
+}
+
+int JVSIO_Client_isDataAvailable(void) {
+  return rx_rest;
+}
+
+void JVSIO_Client_send(uint8_t data) {
+  (void)data;
+}
+
+uint8_t JVSIO_Client_receive(void) {
+  rx_rest--;
+  return *rx_ptr++;
+}
+
+void JVSIO_Client_willSend(void) {}
+
+void JVSIO_Client_willReceive(void) {}
+
+void JVSIO_Client_dump(const char* str, uint8_t* data, uint8_t len) {
+  (void)str;
+  (void)data;
+  (void)len;
+}
+
+bool JVSIO_Client_isSenseReady(void) {
+  return true;
+}
+
+bool JVSIO_Client_receiveCommand(uint8_t node,
+                                 uint8_t* command,
+                                 uint8_t len,
+                                 bool commit) {
+  (void)node;
+  (void)len;
+  (void)commit;
+  switch (*command) {
+    case kCmdIoId:
+      JVSIO_Node_pushReport(kReportOk);
+      for (const char* id = "JVSIO;bench;0.1"; *id; ++id)
+        JVSIO_Node_pushReport(*id);
+      JVSIO_Node_pushReport(0);
+      break;
+    case kCmdFunctionCheck:
+      JVSIO_Node_pushReport(kReportOk);
+      JVSIO_Node_pushReport(0x01);
+      JVSIO_Node_pushReport(0x02);
+      JVSIO_Node_pushReport(0x10);
+      JVSIO_Node_pushReport(0x00);
+      JVSIO_Node_pushReport(0x02);
+      JVSIO_Node_pushReport(0x02);
+      JVSIO_Node_pushReport(0x00);
+      JVSIO_Node_pushReport(0x00);
+      JVSIO_Node_pushReport(0x00);
+      break;
+    case kCmdSwInput:
+      JVSIO_Node_pushReport(kReportOk);
+      for (uint8_t i = 0; i < 1 + command[1] * command[2]; ++i)
+        JVSIO_Node_pushReport(0x00);
+      break;
+    case kCmdCoinInput:
+      JVSIO_Node_pushReport(kReportOk);
+      for (uint8_t i = 0; i < command[1] * 2; ++i)
+        JVSIO_Node_pushReport(0x00);
+      break;
+    case kCmdDriverOutput:
+      JVSIO_Node_pushReport(kReportOk);
+      break;
+    default:
+      return false;
+  }
+  return true;
+}
+
+bool JVSIO_Client_setCommSupMode(enum JVSIO_CommSupMode mode, bool dryrun) {
+  (void)mode;
+  (void)dryrun;
+  return false;
+}
+
+void JVSIO_Client_setSense(bool ready) {
+  (void)ready;
+}
+
+void JVSIO_Client_setLed(bool ready) {
+  (void)ready;
+}
+
+void JVSIO_Client_delayMicroseconds(unsigned int usec) {
+  // Waits for the bus are not counted.
+  (void)usec;
+}
+
+void main(void) {
+  TMOD = (TMOD & 0xf0) | 0x01;
+  ET0 = 1;
+  EA = 1;
+
+  JVSIO_Node_init(1);
+  putString("packet", 18);
+  putString("   cycles  speculative\n", 0);
+  for (uint8_t i = 0; i < sizeof(packets) / sizeof(packets[0]); ++i) {
+    const struct Packet* packet = &packets[i];
+    uint32_t cycles = measure(packet, false);
+    uint32_t speculative = measure(packet, true);
+    putString(packet->name, 18);
+    putNumber(cycles, 9);
+    putNumber(speculative, 13);
+    putChar('\n');
+  }
+  simif = 's';
+  for (;;)
+    ;
+}
@@ -0,0 +1,337 @@
+// Copyright 2023 Takashi Toyoshima <toyoshim@gmail.com>.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#if !defined(__JVSIO_HPP__)
+#define __JVSIO_HPP__
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+extern "C" {
+#include "jvsio_client.h"
+#include "jvsio_common.h"
+#include "jvsio_host.h"
+}
+
+// Header-only C++17 helpers on top of the C APIs. Commands and request frames
+// can be built in constant expressions, so that fixed requests, e.g. polls,
+// cost nothing at runtime. Frames are sent as is via Submit(). Reports in
+// responses are accessed via typed views.
+namespace jvsio {
+
+// Command bytes to be sent in a packet. Commands can be concatenated by
+// Concat() to send multiple commands in a packet.
+template <size_t N>
+struct Command {
+  std::array<uint8_t, N> bytes;
+
+  static constexpr size_t size() { return N; }
+  constexpr const uint8_t* data() const { return bytes.data(); }
+};
+
+constexpr Command<2> Reset() {
+  return {{kCmdReset, 0xD9}};
+}
+
+constexpr Command<2> AddressSet(uint8_t address) {
+  return {{kCmdAddressSet, address}};
+}
+
+constexpr Command<1> IoId() {
+  return {{kCmdIoId}};
+}
+
+constexpr Command<1> CommandRev() {
+  return {{kCmdCommandRev}};
+}
+
+constexpr Command<1> JvRev() {
+  return {{kCmdJvRev}};
+}
+
+constexpr Command<1> ProtocolVer() {
+  return {{kCmdProtocolVer}};
+}
+
+constexpr Command<1> FunctionCheck() {
+  return {{kCmdFunctionCheck}};
+}
+
+// `id` is a string literal, and is sent with the terminating NUL.
+template <size_t N>
+constexpr Command<N + 1> MainId(const char (&id)[N]) {
+  Command<N + 1> command{};
+  command.bytes[0] = kCmdMainId;
+  for (size_t i = 0; i < N; ++i) {
+    command.bytes[1 + i] = static_cast<uint8_t>(id[i]);
+  }
+  return command;
+}
+
+constexpr Command<3> SwInput(uint8_t players, uint8_t bytes) {
+  return {{kCmdSwInput, players, bytes}};
+}
+
+constexpr Command<2> CoinInput(uint8_t slots) {
+  return {{kCmdCoinInput, slots}};
+}
+
+constexpr Command<2> AnalogInput(uint8_t channels) {
+  return {{kCmdAnalogInput, channels}};
+}
+
+constexpr Command<2> RotaryInput(uint8_t channels) {
+  return {{kCmdRotaryInput, channels}};
+}
+
+constexpr Command<1> KeyCodeInput() {
+  return {{kCmdKeyCodeInput}};
+}
+
+constexpr Command<2> ScreenPositionInput(uint8_t channel) {
+  return {{kCmdScreenPositionInput, channel}};
+}
+
+constexpr Command<1> Retry() {
+  return {{kCmdRetry}};
+}
+
+// `slot` is 1 for the first slot.
+constexpr Command<4> CoinSub(uint8_t slot, uint16_t count) {
+  return {{kCmdCoinSub, slot, static_cast<uint8_t>(count >> 8),
+           static_cast<uint8_t>(count)}};
+}
+
+constexpr Command<4> CoinAdd(uint8_t slot, uint16_t count) {
+  return {{kCmdCoinAdd, slot, static_cast<uint8_t>(count >> 8),
+           static_cast<uint8_t>(count)}};
+}
+
+template <size_t N>
+constexpr Command<N + 2> DriverOutput(const std::array<uint8_t, N>& data) {
+  static_assert(N < 256, "too many bytes");
+  Command<N + 2> command{};
+  command.bytes[0] = kCmdDriverOutput;
+  command.bytes[1] = N;
+  for (size_t i = 0; i < N; ++i) {
+    command.bytes[2 + i] = data[i];
+  }
+  return command;
+}
+
+template <size_t N>
+constexpr Command<N * 2 + 2> AnalogOutput(const std::array<uint16_t, N>& data) {
+  static_assert(N < 128, "too many channels");
+  Command<N * 2 + 2> command{};
+  command.bytes[0] = kCmdAnalogOutput;
+  command.bytes[1] = N;
+  for (size_t i = 0; i < N; ++i) {
+    command.bytes[2 + i * 2] = static_cast<uint8_t>(data[i] >> 8);
+    command.bytes[3 + i * 2] = static_cast<uint8_t>(data[i]);
+  }
+  return command;
+}
+
+template <size_t N>
+constexpr Command<N + 2> CharacterOutput(const std::array<uint8_t, N>& data) {
+  static_assert(N < 256, "too many bytes");
+  Command<N + 2> command{};
+  command.bytes[0] = kCmdCharacterOutput;
+  command.bytes[1] = N;
+  for (size_t i = 0; i < N; ++i) {
+    command.bytes[2 + i] = data[i];
+  }
+  return command;
+}
+
+// `data` follows the vendor specific command byte as is.
+template <size_t N>
+constexpr Command<N + 1> Namco(const std::array<uint8_t, N>& data) {
+  Command<N + 1> command{};
+  command.bytes[0] = kCmdNamco;
+  for (size_t i = 0; i < N; ++i) {
+    command.bytes[1 + i] = data[i];
+  }
+  return command;
+}
+
+constexpr Command<1> CommSup() {
+  return {{kCmdCommSup}};
+}
+
+constexpr Command<2> CommChg(JVSIO_CommSupMode mode) {
+  return {{kCmdCommChg, static_cast<uint8_t>(mode)}};
+}
+
+template <size_t N, size_t M>
+constexpr Command<N + M> Concat(const Command<N>& first,
+                                const Command<M>& second) {
+  Command<N + M> command{};
+  for (size_t i = 0; i < N; ++i) {
+    command.bytes[i] = first.bytes[i];
+  }
+  for (size_t i = 0; i < M; ++i) {
+    command.bytes[N + i] = second.bytes[i];
+  }
+  return command;
+}
+
+template <size_t N, size_t M, typename... Rest>
+constexpr auto Concat(const Command<N>& first,
+                      const Command<M>& second,
+                      const Rest&... rest) {
+  return Concat(Concat(first, second), rest...);
+}
+
+// A request frame to send on the bus as is, that contains SYNC, escaped
+// address, size, commands, and checksum bytes.
+template <size_t N>
+struct Frame {
+  std::array<uint8_t, 1 + (N + 3) * 2> bytes;
+  size_t size;
+
+  constexpr const uint8_t* data() const { return bytes.data(); }
+};
+
+namespace internal {
+
+template <size_t N>
+constexpr void PushEscaped(Frame<N>& frame, uint8_t data) {
+  if (data == kMarker || data == kSync) {
+    frame.bytes[frame.size++] = kMarker;
+    frame.bytes[frame.size++] = static_cast<uint8_t>(data - 1);
+  } else {
+    frame.bytes[frame.size++] = data;
+  }
+}
+
+}  // namespace internal
+
+template <size_t N>
+constexpr Frame<N> BuildFrame(uint8_t address, const Command<N>& command) {
+  static_assert(N > 0 && N < 255, "invalid command size");
+  Frame<N> frame{};
+  frame.bytes[frame.size++] = kSync;
+  uint8_t sum = static_cast<uint8_t>(address + N + 1);
+  internal::PushEscaped(frame, address);
+  internal::PushEscaped(frame, static_cast<uint8_t>(N + 1));
+  for (size_t i = 0; i < N; ++i) {
+    sum = static_cast<uint8_t>(sum + command.bytes[i]);
+    internal::PushEscaped(frame, command.bytes[i]);
+  }
+  internal::PushEscaped(frame, sum);
+  return frame;
+}
+
+#if defined(JVSIO_HOST_QUEUE)
+// JVSIO_Host_submit() for commands that are checked to fit in the queue at
+// compile time.
+template <size_t N>
+uint8_t Submit(uint8_t address,
+               const Command<N>& command,
+               uint8_t priority,
+               uint32_t deadline) {
+  static_assert(N <= JVSIO_HOST_QUEUE_COMMAND_SIZE, "command is too long");
+  return JVSIO_Host_submit(address, command.data(), N, priority, deadline);
+}
+
+// JVSIO_Host_submitFrame() for frames built by BuildFrame(). The frame is not
+// copied, and should outlive the transaction, e.g. a static constexpr one.
+template <size_t N>
+uint8_t Submit(const Frame<N>& frame, uint8_t priority, uint32_t deadline) {
+  static_assert(sizeof(frame.bytes) < 256, "frame is too long");
+  return JVSIO_Host_submitFrame(frame.data(), frame.size, priority, deadline);
+}
+#endif
+
+// Reports for SwInput. `data` points to the system byte that follows the
+// report status byte. `player` is 0 for the system byte, or 1 for the first
+// player, and `index` is the bit position from the MSB of the first byte for
+// the player, as JVSIO_InputEvent does.
+class SwitchView {
+ public:
+  constexpr SwitchView(const uint8_t* data, uint8_t players, uint8_t bytes)
+      : data_(data), players_(players), bytes_(bytes) {}
+
+  constexpr uint8_t players() const { return players_; }
+  constexpr uint8_t bytes() const { return bytes_; }
+
+  constexpr uint8_t GetByte(uint8_t player, uint8_t byte) const {
+    return player ? data_[1 + (player - 1) * bytes_ + byte] : data_[0];
+  }
+  constexpr bool IsPressed(uint8_t player, uint8_t index) const {
+    return GetByte(player, index / 8) & (0x80 >> (index % 8));
+  }
+  constexpr bool IsTestPressed() const { return data_[0] & 0x80; }
+
+ private:
+  const uint8_t* data_;
+  uint8_t players_;
+  uint8_t bytes_;
+};
+
+// Reports for CoinInput. `data` points to the first byte that follows the
+// report status byte. `slot` is 1 for the first slot.
+class CoinView {
+ public:
+  constexpr CoinView(const uint8_t* data, uint8_t slots)
+      : data_(data), slots_(slots) {}
+
+  constexpr uint8_t slots() const { return slots_; }
+
+  constexpr uint8_t GetCondition(uint8_t slot) const {
+    return data_[(slot - 1) * 2] >> 6;
+  }
+  constexpr uint16_t GetCount(uint8_t slot) const {
+    return ((data_[(slot - 1) * 2] & 0x3F) << 8) | data_[(slot - 1) * 2 + 1];
+  }
+
+ private:
+  const uint8_t* data_;
+  uint8_t slots_;
+};
+
+// Reports for AnalogInput. `data` points to the first byte that follows the
+// report status byte. `channel` is 0 for the first channel.
+class AnalogView {
+ public:
+  constexpr AnalogView(const uint8_t* data, uint8_t channels)
+      : data_(data), channels_(channels) {}
+
+  constexpr uint8_t channels() const { return channels_; }
+
+  constexpr uint16_t GetValue(uint8_t channel) const {
+    return (data_[channel * 2] << 8) | data_[channel * 2 + 1];
+  }
+
+ private:
+  const uint8_t* data_;
+  uint8_t channels_;
+};
+
+#if defined(JVSIO_HOST_SYNC_REPORT)
+// Typed access to a report notified via JVSIO_Client_syncReceived(). Valid
+// only during the callback as the report is.
+class SyncView {
+ public:
+  explicit constexpr SyncView(const JVSIO_SyncReport& report)
+      : report_(report) {}
+
+  constexpr SwitchView GetSwitches() const {
+    return SwitchView(report_.data + report_.switch_offset, report_.players,
+                      report_.switch_bytes);
+  }
+  constexpr CoinView GetCoins() const {
+    return CoinView(report_.data + report_.coin_offset, report_.coin_slots);
+  }
+
+ private:
+  const JVSIO_SyncReport& report_;
+};
+#endif
+
+}  // namespace jvsio
+
+#endif  // !defined(__JVSIO_HPP__)
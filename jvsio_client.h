@@ -8,6 +8,8 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "jvsio_config.h"
+
 enum JVSIO_CommSupMode {
   k115200 = 0,
   k1M = 1,
@@ -18,23 +20,63 @@ enum JVSIO_CommSupMode {
 // operaqtions, such as driving bus signals or controlling led hints.
 
 // Required for both client nodes and hosts.
+#if defined(JVSIO_BULK_IO)
+// Sends `len` bytes, or stores up to `len` bytes that are available without
+// blocking into `data` and returns the number of stored bytes.
+void JVSIO_Client_sendBytes(const uint8_t* data, uint16_t len);
+uint16_t JVSIO_Client_receiveBytes(uint8_t* data, uint16_t len);
+#elif !defined(JVSIO_INLINE_IO)
 int JVSIO_Client_isDataAvailable(void);
-void JVSIO_Client_willSend(void);
-void JVSIO_Client_willReceive(void);
 void JVSIO_Client_send(uint8_t data);
 uint8_t JVSIO_Client_receive(void);
+#endif
+void JVSIO_Client_willSend(void);
+void JVSIO_Client_willReceive(void);
 void JVSIO_Client_dump(const char* str, uint8_t* data, uint8_t len);
 bool JVSIO_Client_isSenseReady(void);
+#if defined(JVSIO_MICROSECOND_TICK)
+uint32_t JVSIO_Client_getMicroseconds(void);
+#endif
 
 // Required for client nodes.
+#if defined(JVSIO_NODE_BATCH)
+// A command in the packet. `data` starts with the `opcode`, and contains
+// `len` bytes including arguments.
+struct JVSIO_Command {
+  uint8_t* data;
+  uint8_t len;
+  uint8_t opcode;
+};
+
+// Handles `count` commands in a verified packet for `node` at once. Reports
+// for the commands, each starting with the report status byte, are written to
+// `report` of `size` bytes in order, and `len` is set to the bytes written, or
+// the bytes needed if they don't fit to reply with the overflow status.
+// Returns false if a command is unknown, and reports for commands before it
+// are sent with the unknown command status.
+bool JVSIO_Client_receiveCommands(uint8_t node,
+                                  const struct JVSIO_Command* commands,
+                                  uint8_t count,
+                                  uint8_t* report,
+                                  uint8_t size,
+                                  uint8_t* len);
+#else
 bool JVSIO_Client_receiveCommand(uint8_t node,
                                  uint8_t* command,
                                  uint8_t len,
                                  bool commit);
+#endif
+#if !defined(JVSIO_COMM_115200_ONLY)
 bool JVSIO_Client_setCommSupMode(enum JVSIO_CommSupMode mode, bool dryrun);
+#endif
 void JVSIO_Client_setSense(bool ready);
 void JVSIO_Client_setLed(bool ready);
 void JVSIO_Client_delayMicroseconds(unsigned int usec);
+#if defined(JVSIO_NODE_ASYNC_TX)
+// Called when a response is ready to pull via JVSIO_Node_pullByte(), e.g. to
+// enable the UART TX interrupt.
+void JVSIO_Client_startSending(void);
+#endif
 
 // Required for hosts.
 bool JVSIO_Client_isSenseConnected(void);
@@ -51,4 +93,36 @@ void JVSIO_Client_synced(uint8_t players,
                          uint8_t* sw_state0,
                          uint8_t* sw_state1);
 
+// Required for hosts built with JVSIO_HOST_SYNC_REPORT.
+#if defined(JVSIO_HOST_SYNC_REPORT)
+// Validated response for a sync request. `data` points to the status byte in
+// the receive buffer, and is valid only during the callback. Offsets point to
+// the first byte of each report that follows the report status byte.
+struct JVSIO_SyncReport {
+  const uint8_t* data;
+  uint8_t len;
+  uint8_t players;
+  uint8_t switch_bytes;  // Bytes per player.
+  uint8_t coin_slots;
+  uint8_t switch_offset;  // The system byte, followed by player bytes.
+  uint8_t coin_offset;    // 2 bytes per slot.
+};
+void JVSIO_Client_syncReceived(uint8_t address,
+                               const struct JVSIO_SyncReport* report);
+#endif
+
+// Required for hosts built with JVSIO_HOST_CACHE.
+#if defined(JVSIO_HOST_CACHE)
+struct JVSIO_DeviceCache;
+void JVSIO_Client_deviceCacheUpdated(uint8_t address,
+                                     const struct JVSIO_DeviceCache* cache);
+#endif
+
+// Required for hosts built with JVSIO_HOST_QUEUE.
+#if defined(JVSIO_HOST_QUEUE)
+void JVSIO_Client_transactionCompleted(uint8_t id,
+                                       uint8_t* status,
+                                       uint8_t len);
+#endif
+
 #endif  // !defined(__JVSIO_CLIENT_H__)
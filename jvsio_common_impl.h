@@ -6,35 +6,114 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "jvsio_client.h"
+#include "jvsio_config.h"
 
-static uint8_t tx_data[256];
-static uint8_t tx_report_size;
+#if JVSIO_RX_BUFFER_SIZE > 256 || JVSIO_TX_BUFFER_SIZE > 256
+#error "Buffer sizes should not exceed 256 bytes"
+#endif
 
-static uint8_t rx_data[256];
-static uint8_t rx_size;
-static uint8_t rx_read_ptr;
-static bool rx_receiving;
-static bool rx_escaping;
-static bool rx_available;
-static bool rx_error;
+// This file is included by jvsio_host.c, that defines JVSIO_IMPL_HOST before
+// including it, or jvsio_node.c. Code only for the other side is folded at
+// compile time.
 
+// Nodes built with JVSIO_NODE_ASYNC_TX send packets via JVSIO_Node_pullByte()
+// instead of sendPacket().
+#if !defined(JVSIO_NODE_ASYNC_TX) || defined(JVSIO_IMPL_HOST)
+#define JVSIO_SEND_PACKET
+#endif
+
+// Hosts and single node builds own only one address.
+#if !defined(JVSIO_IMPL_HOST) && JVSIO_NODE_MAX > 1
+#define JVSIO_NODE_MAP
+#endif
+
+enum {
+#if defined(JVSIO_SHARED_BUFFER)
+  kTxBufferSize = JVSIO_RX_BUFFER_SIZE,
+#else
+  kTxBufferSize = JVSIO_TX_BUFFER_SIZE,
+#endif
+  // Reports follow the address, size, and status bytes. The size byte counts
+  // the status, reports, and the checksum, and should fit in a byte.
+  kReportSizeMax = (kTxBufferSize < 256) ? (kTxBufferSize - 3) : 253,
+};
+
+static JVSIO_XDATA uint8_t rx_data[JVSIO_RX_BUFFER_SIZE];
+#if defined(JVSIO_SHARED_BUFFER)
+// Packets to send are built in place in the receive buffer.
+#define tx_data rx_data
+#else
+static JVSIO_XDATA uint8_t tx_data[JVSIO_TX_BUFFER_SIZE];
+#endif
+static JVSIO_DATA uint8_t tx_report_size;
+
+static JVSIO_DATA uint8_t rx_size;
+static JVSIO_DATA uint8_t rx_read_ptr;
+static JVSIO_DATA bool rx_receiving;
+static JVSIO_DATA bool rx_escaping;
+static JVSIO_DATA bool rx_available;
+static JVSIO_DATA bool rx_error;
+#if defined(JVSIO_MICROSECOND_TICK)
+static uint32_t rx_tick;  // When the last packet is received.
+#endif
+
+static uint8_t address[JVSIO_NODE_MAX];
+#if defined(JVSIO_COMM_115200_ONLY)
+static inline enum JVSIO_CommSupMode getCommMode(void) {
+  return k115200;
+}
+#else
+static enum JVSIO_CommSupMode comm_mode;
+static inline enum JVSIO_CommSupMode getCommMode(void) {
+  return comm_mode;
+}
+#endif
+
+#if defined(JVSIO_NODE_MAP)
 static uint8_t nodes;
-static uint8_t address[2];
+static inline uint8_t getNodes(void) {
+  return nodes;
+}
+// Maps each bus address to the index of the logical node that owns it, or
+// kBroadcastAddress if no node owns the address.
+static JVSIO_XDATA uint8_t node_map[256];
+#else
+static inline uint8_t getNodes(void) {
+  return 1;
+}
+#endif
+#if !defined(JVSIO_IMPL_HOST)
 static bool downstream_ready;
+#endif
 
-static bool matchAddress(void) {
-  uint8_t target = rx_data[0];
-  for (uint8_t i = 0; i < nodes; ++i) {
-    if (target == address[i]) {
-      return true;
-    }
+static void resetAddresses(void) {
+#if defined(JVSIO_NODE_MAP)
+  memset(node_map, kBroadcastAddress, sizeof(node_map));
+#endif
+  for (uint8_t i = 0; i < getNodes(); ++i) {
+    address[i] = kBroadcastAddress;
   }
-  return false;
 }
 
-static bool getCommandSize(uint8_t* command, uint8_t len, uint8_t* size) {
+static void assignAddress(uint8_t node, uint8_t new_address) {
+  address[node] = new_address;
+#if defined(JVSIO_NODE_MAP)
+  node_map[new_address] = node;
+#endif
+}
+
+static bool matchAddress(void) {
+#if defined(JVSIO_NODE_MAP)
+  return node_map[rx_data[0]] != kBroadcastAddress;
+#else
+  return rx_data[0] == address[0];
+#endif
+}
+
+static bool getCommandSize(const uint8_t* command, uint8_t len, uint8_t* size) {
   switch (*command) {
     case kCmdReset:
     case kCmdAddressSet:
@@ -130,6 +209,96 @@ static bool getCommandSize(uint8_t* command, uint8_t len, uint8_t* size) {
   return true;
 }
 
+#if defined(JVSIO_BULK_IO)
+// Word-at-a-time helpers. A word is loaded via memcpy() as packets are not
+// aligned.
+#define kWordOnes 0x0101010101010101ull
+
+static uint64_t loadWord(const uint8_t* data) {
+  uint64_t word;
+  memcpy(&word, data, sizeof(word));
+  return word;
+}
+
+// Returns true if the word may contain kMarker or kSync. It may return true
+// for a clean word after a matching byte, and callers fall back to the byte
+// path for such words.
+static bool hasSpecialByte(uint64_t word) {
+  uint64_t marker = word ^ (kWordOnes * kMarker);
+  uint64_t sync = word ^ (kWordOnes * kSync);
+  return (((marker - kWordOnes) & ~marker) | ((sync - kWordOnes) & ~sync)) &
+         (kWordOnes * 0x80);
+}
+
+static uint8_t sumWord(uint64_t word) {
+  uint64_t pairs = (word & 0x00FF00FF00FF00FFull) +
+                   ((word >> 8) & 0x00FF00FF00FF00FFull);
+  return (pairs * 0x0001000100010001ull) >> 48;
+}
+
+static uint8_t sumBytes(const uint8_t* data, uint16_t len) {
+  uint8_t sum = 0;
+  uint16_t i = 0;
+  for (; (i + 8u) <= len; i += 8u) {
+    sum += sumWord(loadWord(&data[i]));
+  }
+  for (; i < len; ++i) {
+    sum += data[i];
+  }
+  return sum;
+}
+
+#endif
+
+#if defined(JVSIO_SEND_PACKET)
+#if defined(JVSIO_BULK_IO)
+// Escapes `len` bytes of `data` into `out`, and adds them to `sum`. Returns
+// the size of escaped bytes.
+static uint16_t escapeBytes(uint8_t* out,
+                            const uint8_t* data,
+                            uint16_t len,
+                            uint8_t* sum) {
+  uint16_t size = 0;
+  uint16_t i = 0;
+  while (i < len) {
+    uint16_t end = i + 1u;
+    if ((i + 8u) <= len) {
+      uint64_t word = loadWord(&data[i]);
+      if (!hasSpecialByte(word)) {
+        memcpy(&out[size], &word, sizeof(word));
+        *sum += sumWord(word);
+        size += 8u;
+        i += 8u;
+        continue;
+      }
+      end = i + 8u;
+    }
+    for (; i < end; ++i) {
+      *sum += data[i];
+      if (data[i] == kMarker || data[i] == kSync) {
+        out[size++] = kMarker;
+        out[size++] = data[i] - 1;
+      } else {
+        out[size++] = data[i];
+      }
+    }
+  }
+  return size;
+}
+
+static void sendPacket(void) {
+  // SYNC, and escaped bytes for the packet and the checksum.
+  static uint8_t frame[1 + (kTxBufferSize + 1) * 2];
+  uint8_t sum = 0;
+  frame[0] = kSync;
+  uint16_t size = 1 + escapeBytes(&frame[1], tx_data, tx_data[1] + 1u, &sum);
+  uint8_t checksum = sum;
+  size += escapeBytes(&frame[size], &checksum, 1, &sum);
+  JVSIO_Client_sendBytes(frame, size);
+
+  JVSIO_Client_willReceive();
+}
+#else
 static void writeEscapedByte(uint8_t data) {
   if (data == kMarker || data == kSync) {
     JVSIO_Client_send(kMarker);
@@ -151,7 +320,10 @@ static void sendPacket(void) {
 
   JVSIO_Client_willReceive();
 }
+#endif
+#endif  // defined(JVSIO_SEND_PACKET)
 
+#if !defined(JVSIO_IMPL_HOST)
 static void pushOverflowStatus(void) {
   tx_data[0] = kHostAddress;
   tx_data[1] = 2;
@@ -159,46 +331,59 @@ static void pushOverflowStatus(void) {
 }
 
 static void pushUnknownCommandStatus(void) {
-  if (tx_report_size > 253) {
+  if (tx_report_size > kReportSizeMax) {
     return pushOverflowStatus();
   }
   tx_data[0] = kHostAddress;
   tx_data[1] = 2 + tx_report_size;
   tx_data[2] = 0x02;
 }
+#endif
+
+// Decodes a received byte into `rx_data`.
+static void receiveByte(uint8_t data) {
+  if (data == kSync) {
+    rx_size = 0;
+    rx_read_ptr = 2;
+    rx_receiving = true;
+    rx_available = false;
+    rx_escaping = false;
+    rx_error = false;
+    tx_report_size = 0;
+#if !defined(JVSIO_IMPL_HOST)
+    downstream_ready = JVSIO_Client_isSenseReady();
+#endif
+    return;
+  }
+  if (!rx_receiving) {
+    return;
+  }
+  if (rx_size >= 2 && rx_size >= (rx_data[1] + 2u)) {
+    // Ignore bytes after the checksum until the next SYNC.
+    return;
+  }
+  if (data == kMarker) {
+    rx_escaping = true;
+    return;
+  }
+  if (rx_escaping) {
+    rx_data[rx_size++] = data + 1;
+    rx_escaping = false;
+  } else {
+    rx_data[rx_size++] = data;
+  }
+  if (rx_size == 2 && (rx_data[1] + 2u) > JVSIO_RX_BUFFER_SIZE) {
+    // Ignore packets that don't fit into the buffer.
+    rx_receiving = false;
+  }
+}
 
 // If `speculative` is true, `rx_available` is set to true when a command is
 // ready to process spculatively. If `rx_receiving` is still true, the packet
 // isn't verified yet. `rx_receiving` is set to false for the last command.
 // Caller should set `rx_available` to false after processing the command.
-static void receive(bool speculative) {
-  while (JVSIO_Client_isDataAvailable()) {
-    uint8_t data = JVSIO_Client_receive();
-    if (data == kSync) {
-      rx_size = 0;
-      rx_read_ptr = 2;
-      rx_receiving = true;
-      rx_available = false;
-      rx_escaping = false;
-      rx_error = false;
-      tx_report_size = 0;
-      downstream_ready = JVSIO_Client_isSenseReady();
-      continue;
-    }
-    if (!rx_receiving) {
-      continue;
-    }
-    if (data == kMarker) {
-      rx_escaping = true;
-      continue;
-    }
-    if (rx_escaping) {
-      rx_data[rx_size++] = data + 1;
-      rx_escaping = false;
-    } else {
-      rx_data[rx_size++] = data;
-    }
-  }
+// This can be called repeatedly for the same received data.
+static void checkPacket(bool speculative) {
   if (!rx_receiving) {
     return;
   }
@@ -214,6 +399,7 @@ static void receive(bool speculative) {
     // No data.
     return;
   }
+#if !defined(JVSIO_IMPL_HOST)
   if (speculative) {
     // Speculatively handle receiving commands.
     uint8_t command_size;
@@ -237,6 +423,9 @@ static void receive(bool speculative) {
       return;
     }
   }
+#else
+  (void)speculative;
+#endif
 
   // Wait for the last byte, checksum.
   if ((rx_data[1] + 2) != rx_size) {
@@ -246,19 +435,71 @@ static void receive(bool speculative) {
   // Let's calculate the checksum.
   rx_receiving = false;
   rx_available = true;
+#if defined(JVSIO_MICROSECOND_TICK)
+  rx_tick = JVSIO_Client_getMicroseconds();
+#endif
+#if defined(JVSIO_BULK_IO)
+  uint8_t sum = sumBytes(rx_data, rx_size - 1u);
+#else
   uint8_t sum = 0;
   for (size_t i = 0; i < (rx_size - 1u); ++i) {
     sum += rx_data[i];
   }
+#endif
   if (rx_data[rx_size - 1] != sum) {
-    // Handles check sum error cases.
-    if (address[0] == kHostAddress) {
-      // Host mode does not need to send an error response back.
-    } else if (rx_data[2] == kCmdReset || rx_data[2] == kCmdCommChg) {
+    // Handles check sum error cases. Host mode does not need to send an error
+    // response back.
+#if !defined(JVSIO_IMPL_HOST)
+    if (rx_data[2] == kCmdReset || rx_data[2] == kCmdCommChg) {
       // These commands don't need a response.
     } else {
       // Reply with the error and ignore commands in the packet.
       rx_error = true;
     }
+#endif
+  }
+}
+
+#if defined(JVSIO_BULK_IO)
+// Decodes received bytes into `rx_data`. Runs without special bytes in the
+// rest of the packet are copied word-at-a-time.
+static void receiveBytes(const uint8_t* data, uint16_t len) {
+  uint16_t i = 0;
+  while (i < len) {
+    if (rx_receiving && !rx_escaping && rx_size >= 2 &&
+        rx_size < (rx_data[1] + 2u)) {
+      uint16_t rest = rx_data[1] + 2u - rx_size;
+      if (rest > (len - i)) {
+        rest = len - i;
+      }
+      for (; rest >= 8u; rest -= 8u) {
+        uint64_t word = loadWord(&data[i]);
+        if (hasSpecialByte(word)) {
+          break;
+        }
+        memcpy(&rx_data[rx_size], &word, sizeof(word));
+        rx_size += 8u;
+        i += 8u;
+      }
+      if (i == len) {
+        break;
+      }
+    }
+    receiveByte(data[i++]);
+  }
+}
+#endif
+
+static void receive(bool speculative) {
+#if defined(JVSIO_BULK_IO)
+  uint8_t data[64];
+  for (uint16_t len; (len = JVSIO_Client_receiveBytes(data, sizeof(data)));) {
+    receiveBytes(data, len);
+  }
+#else
+  while (JVSIO_Client_isDataAvailable()) {
+    receiveByte(JVSIO_Client_receive());
   }
+#endif
+  checkPacket(speculative);
 }
@@ -0,0 +1,171 @@
+// Copyright 2023 Takashi Toyoshima <toyoshim@gmail.com>.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#if !defined(__JVSIO_CONFIG_H__)
+#define __JVSIO_CONFIG_H__
+
+// Compile-time configurations. Each value can be overridden by a -D flag, or
+// by a header that JVSIO_CONFIG_HEADER names, e.g.
+// -DJVSIO_CONFIG_HEADER=\"board_jvsio.h\".
+#if defined(JVSIO_CONFIG_HEADER)
+#include JVSIO_CONFIG_HEADER
+#endif
+
+// Define JVSIO_INLINE_IO in the config header that also provides
+// JVSIO_Client_isDataAvailable(), JVSIO_Client_receive(), and
+// JVSIO_Client_send() as static inline functions or macros, so that they are
+// expanded in the per-byte loops instead of being called, e.g.
+//   #define JVSIO_INLINE_IO
+//   #define JVSIO_Client_isDataAvailable() RI
+//   static inline uint8_t JVSIO_Client_receive(void) {
+//     RI = 0;
+//     return SBUF;
+//   }
+//   static inline void JVSIO_Client_send(uint8_t data) {
+//     TI = 0;
+//     SBUF = data;
+//     while (!TI)
+//       ;
+//   }
+
+// Storage classes for the protocol state on SDCC MCS-51 builds. Scalars that
+// are accessed for each byte are placed in the directly addressable internal
+// RAM, and buffers are placed in the external RAM, regardless of the memory
+// model. Define JVSIO_DATA as __idata if the direct RAM is short. They expand
+// to nothing on other compilers.
+#if defined(__SDCC_mcs51)
+#if !defined(JVSIO_DATA)
+#define JVSIO_DATA __data
+#endif
+#if !defined(JVSIO_XDATA)
+#define JVSIO_XDATA __xdata
+#endif
+#else
+#define JVSIO_DATA
+#define JVSIO_XDATA
+#endif
+
+// Buffer sizes for packets to receive and to send, up to 256 bytes. Packets
+// that don't fit into the receive buffer are ignored.
+// If JVSIO_SHARED_BUFFER is defined, packets to send are built in place in the
+// receive buffer instead, and JVSIO_TX_BUFFER_SIZE isn't used. Nodes in this
+// mode process commands after the whole packet is verified, i.e. speculative
+// mode is not available. Hosts don't support this mode.
+#if !defined(JVSIO_RX_BUFFER_SIZE)
+#define JVSIO_RX_BUFFER_SIZE 256
+#endif
+#if !defined(JVSIO_TX_BUFFER_SIZE)
+#define JVSIO_TX_BUFFER_SIZE 256
+#endif
+
+// Define JVSIO_MICROSECOND_TICK if the client provides
+// JVSIO_Client_getMicroseconds(). Nodes use it to wait only for the rest of the
+// minimum interval before responses, and hosts use it for response timeouts
+// instead of JVSIO_Client_getTick() in milliseconds.
+
+// Define JVSIO_BULK_IO if the client provides JVSIO_Client_sendBytes() and
+// JVSIO_Client_receiveBytes() instead of byte-wise APIs, e.g. on Linux. Packets
+// are escaped and unescaped by word-at-a-time kernels that copy runs without
+// special bytes in bulk. Don't define it for 8-bit targets.
+
+// Define JVSIO_NODE_ASYNC_TX to let nodes return from JVSIO_Node_run() before
+// responses are sent. The node calls JVSIO_Client_startSending() instead of
+// sending bytes, and the client pulls escaped bytes via JVSIO_Node_pullByte(),
+// e.g. in a UART TX interrupt handler.
+
+// Maximum number of logical nodes that a physical node can emulate. Nodes
+// built with 1 don't keep the 256 bytes address map.
+#if !defined(JVSIO_NODE_MAX)
+#define JVSIO_NODE_MAX 2
+#endif
+
+// Define JVSIO_NODE_SPECULATIVE to 1 or 0 to let nodes always run in the
+// speculative mode or never, regardless of the `speculative` argument. Code
+// for the other mode is not built. JVSIO_SHARED_BUFFER and JVSIO_NODE_BATCH
+// imply 0.
+#if (defined(JVSIO_SHARED_BUFFER) || defined(JVSIO_NODE_BATCH)) && \
+    !defined(JVSIO_NODE_SPECULATIVE)
+#define JVSIO_NODE_SPECULATIVE 0
+#endif
+
+// Define JVSIO_NODE_BATCH to let nodes pass commands in a verified packet to
+// JVSIO_Client_receiveCommands() at once, instead of calling
+// JVSIO_Client_receiveCommand() for each. Commands that the library handles
+// split the batch so that reports keep the order. Up to JVSIO_NODE_BATCH_SIZE
+// commands are passed in a call.
+#if !defined(JVSIO_NODE_BATCH_SIZE)
+#define JVSIO_NODE_BATCH_SIZE 16
+#endif
+
+// Define JVSIO_COMM_115200_ONLY to support only the default bus speed. Nodes
+// don't offer JVS Dash high speed modes, and clients don't need to provide
+// JVSIO_Client_setCommSupMode().
+
+// Time that hosts allow devices to start responses after requests are sent, in
+// addition to the time to transfer the response at the bus speed. Hosts
+// connected via high-latency bridges, e.g. USB serial adapters, may need a
+// larger value.
+#if !defined(JVSIO_HOST_TURNAROUND_US)
+#define JVSIO_HOST_TURNAROUND_US 2000
+#endif
+
+// Maximum number of devices that a host tracks capabilities for. Devices beyond
+// it are identified, but are not polled by syncs.
+#if !defined(JVSIO_HOST_DEVICE_MAX)
+#define JVSIO_HOST_DEVICE_MAX 4
+#endif
+
+// Sync failures of a device are retried JVSIO_HOST_SYNC_RETRIES times, and the
+// device is queried by IoId. If it still fails, it is marked as degraded, and
+// is polled only once per JVSIO_HOST_DEGRADED_INTERVAL syncs while others are
+// polled as usual. Hosts reset the bus only when the sense line shows that
+// devices lost their addresses.
+#if !defined(JVSIO_HOST_SYNC_RETRIES)
+#define JVSIO_HOST_SYNC_RETRIES 2
+#endif
+#if !defined(JVSIO_HOST_DEGRADED_INTERVAL)
+#define JVSIO_HOST_DEGRADED_INTERVAL 32
+#endif
+
+// Define JVSIO_HOST_CACHE to let hosts skip identification round trips for
+// devices that report the same IoId as the last enumeration.
+#if !defined(JVSIO_HOST_CACHE_IO_ID_SIZE)
+#define JVSIO_HOST_CACHE_IO_ID_SIZE 100
+#endif
+#if !defined(JVSIO_HOST_CACHE_FUNCTION_CHECK_SIZE)
+#define JVSIO_HOST_CACHE_FUNCTION_CHECK_SIZE 32
+#endif
+
+// Define JVSIO_HOST_QUEUE to let hosts send arbitrary commands queued by
+// JVSIO_Host_submit() between syncs.
+#if !defined(JVSIO_HOST_QUEUE_SIZE)
+#define JVSIO_HOST_QUEUE_SIZE 4
+#endif
+#if !defined(JVSIO_HOST_QUEUE_COMMAND_SIZE)
+#define JVSIO_HOST_QUEUE_COMMAND_SIZE 32
+#endif
+
+// Define JVSIO_HOST_OUTPUT to let hosts send general-purpose and analog
+// outputs that are set via JVSIO_Host_set*Output() in syncs.
+#if !defined(JVSIO_HOST_OUTPUT_GPO_SIZE)
+#define JVSIO_HOST_OUTPUT_GPO_SIZE 4
+#endif
+#if !defined(JVSIO_HOST_OUTPUT_ANALOG_CHANNELS)
+#define JVSIO_HOST_OUTPUT_ANALOG_CHANNELS 4
+#endif
+
+// Define JVSIO_HOST_EVENTS to let hosts queue input changes in syncs as events
+// for JVSIO_Host_popInputEvent(). Switch bytes, including the system byte, and
+// coin slots beyond the sizes below are not tracked.
+#if !defined(JVSIO_HOST_EVENT_QUEUE_SIZE)
+#define JVSIO_HOST_EVENT_QUEUE_SIZE 16
+#endif
+#if !defined(JVSIO_HOST_EVENT_SWITCH_BYTES)
+#define JVSIO_HOST_EVENT_SWITCH_BYTES 5
+#endif
+#if !defined(JVSIO_HOST_EVENT_COIN_SLOTS)
+#define JVSIO_HOST_EVENT_COIN_SLOTS 2
+#endif
+
+#endif  // !defined(__JVSIO_CONFIG_H__)
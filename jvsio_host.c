@@ -8,13 +8,25 @@
 #include <stdlib.h>
 
 #include "jvsio_client.h"
+
+#define JVSIO_IMPL_HOST
 #include "jvsio_common_impl.h"
 
+#if defined(JVSIO_SHARED_BUFFER)
+// Responses are read against the request that remains in the send buffer.
+#error "JVSIO_SHARED_BUFFER is not supported for hosts"
+#endif
+
 enum {
   kResetInterval = 500,
-  kResponseTimeout = 100,
+  kUnknownReportBytes = 253,  // Used for responses of unknown size.
+  kPlayerMax = 4,  // Players that JVSIO_Client_synced() reports.
+  kEnumerationCommands = 5,
 };
 
+// Time to transfer a byte in 0.1usec for each JVSIO_CommSupMode.
+static const uint16_t byte_time[] = {868, 100, 33};
+
 enum State {
   kStateDisconnected,
   kStateConnected,
@@ -34,12 +46,17 @@ enum State {
   kStateWaitProtocolVerResponse,
   kStateRequestFunctionCheck,
   kStateWaitFunctionCheckResponse,
+  kStateWaitEnumerationResponse,
 
   kStateReady,
 
   kStateRequestSync,
   kStateWaitSyncResponse,
   kStateWaitCoinSyncResponse,
+  kStateRequestRecovery,
+  kStateWaitRecoveryResponse,
+
+  kStateWaitTransactionResponse,
 
   kStateTimeout,
   kStateInvalidResponse,
@@ -48,15 +65,63 @@ enum State {
 
 static enum State state;
 static uint32_t tick;
+static uint32_t timeout;
+#if defined(JVSIO_MICROSECOND_TICK)
+static uint32_t request_tick;
+#endif
 static uint8_t devices;
 static uint8_t target;
-static uint8_t players[4];
-static uint8_t buttons[4];
-static uint8_t coin_slots[4];
+static bool batch_enumeration;
+static bool batching;
+static uint8_t players[JVSIO_HOST_DEVICE_MAX];
+static uint8_t buttons[JVSIO_HOST_DEVICE_MAX];
+static uint8_t coin_slots[JVSIO_HOST_DEVICE_MAX];
 static uint8_t total_player;
 static uint8_t coin_state;
-static uint8_t sw_state0[4];
-static uint8_t sw_state1[4];
+static uint8_t sw_state0[kPlayerMax];
+static uint8_t sw_state1[kPlayerMax];
+static bool syncing;
+static uint8_t sync_round;
+static uint8_t sync_errors[JVSIO_HOST_DEVICE_MAX];
+static bool degraded[JVSIO_HOST_DEVICE_MAX];
+#if defined(JVSIO_HOST_CACHE)
+static struct JVSIO_DeviceCache cache[JVSIO_HOST_DEVICE_MAX];
+#endif
+#if defined(JVSIO_HOST_OUTPUT)
+enum {
+  kOutputGpo = 1 << 0,
+  kOutputAnalog = 1 << 1,
+};
+static uint8_t gpo_bytes[JVSIO_HOST_DEVICE_MAX];
+static uint8_t gpo[JVSIO_HOST_DEVICE_MAX][JVSIO_HOST_OUTPUT_GPO_SIZE];
+static uint8_t analog_channels[JVSIO_HOST_DEVICE_MAX];
+static uint16_t
+    analog[JVSIO_HOST_DEVICE_MAX][JVSIO_HOST_OUTPUT_ANALOG_CHANNELS];
+static uint8_t output_dirty[JVSIO_HOST_DEVICE_MAX];
+static uint8_t output_sent;
+#endif
+#if defined(JVSIO_HOST_EVENTS)
+static uint8_t last_sw[JVSIO_HOST_DEVICE_MAX][JVSIO_HOST_EVENT_SWITCH_BYTES];
+static uint16_t last_coin[JVSIO_HOST_DEVICE_MAX][JVSIO_HOST_EVENT_COIN_SLOTS];
+static struct JVSIO_InputEvent events[JVSIO_HOST_EVENT_QUEUE_SIZE];
+static uint8_t event_head;
+static uint8_t event_size;
+#endif
+#if defined(JVSIO_HOST_QUEUE)
+struct Transaction {
+  uint8_t id;  // 0 for an empty slot.
+  uint8_t address;
+  uint8_t priority;
+  uint8_t len;
+  uint32_t deadline;
+  const uint8_t* frame;  // Prebuilt frame to send instead, or NULL.
+  uint8_t command[JVSIO_HOST_QUEUE_COMMAND_SIZE];
+};
+static struct Transaction queue[JVSIO_HOST_QUEUE_SIZE];
+static uint8_t last_id;
+static uint8_t transaction_id;
+static bool sync_pending;
+#endif
 
 static bool timeInRange(uint32_t start, uint32_t now, uint32_t duration) {
   uint32_t end = start + duration;
@@ -67,16 +132,543 @@ static bool timeInRange(uint32_t start, uint32_t now, uint32_t duration) {
   return start <= now && now <= end;
 }
 
-static uint8_t* receiveStatus(uint8_t* len) {
-  if (!timeInRange(tick, JVSIO_Client_getTick(), kResponseTimeout)) {
-    state = kStateTimeout;
-    return NULL;
+// Sets up the timeout for the response that contains `report_bytes` for the
+// request that is just sent.
+static void startTimeout(uint8_t report_bytes) {
+  tick = JVSIO_Client_getTick();
+
+  // The request is already sent. The response has SYNC, address, size, and
+  // status bytes, reports, and the checksum. Allow one in eight bytes to be
+  // escaped into two bytes.
+  uint32_t bytes = 5u + report_bytes;
+  bytes += bytes >> 3;
+  uint32_t usec =
+      JVSIO_HOST_TURNAROUND_US + bytes * byte_time[getCommMode()] / 10;
+#if defined(JVSIO_MICROSECOND_TICK)
+  request_tick = JVSIO_Client_getMicroseconds();
+  timeout = usec;
+#else
+  // Add a tick for the granularity.
+  timeout = (usec + 999) / 1000 + 1;
+#endif
+}
+
+// Sends the request in `tx_data` that expects `report_bytes` in the response,
+// and sets up the response timeout.
+static void sendRequest(uint8_t report_bytes) {
+  JVSIO_Client_willSend();
+  sendPacket();
+  startTimeout(report_bytes);
+}
+
+// Syncs poll only devices that capabilities are tracked for.
+static uint8_t getSyncDevices(void) {
+  return (devices < JVSIO_HOST_DEVICE_MAX) ? devices : JVSIO_HOST_DEVICE_MAX;
+}
+
+// Returns the size of the report for the `command`, including the report
+// status byte, if the report is OK. Returns 0 if the size depends on the report
+// itself.
+static uint16_t getFixedReportSize(const uint8_t* command) {
+  switch (*command) {
+    case kCmdIoId:
+    case kCmdFunctionCheck:
+    case kCmdRetry:
+    case kCmdNamco:
+      return 0;
+    case kCmdCommandRev:
+    case kCmdJvRev:
+    case kCmdProtocolVer:
+    case kCmdKeyCodeInput:
+    case kCmdCommSup:
+      return 2;
+    case kCmdSwInput:
+      return 2 + command[1] * command[2];
+    case kCmdCoinInput:
+    case kCmdAnalogInput:
+    case kCmdRotaryInput:
+      return 1 + command[1] * 2;
+    case kCmdScreenPositionInput:
+      return 5;
+    default:
+      // Others, e.g. AddressSet and outputs, contain only the status byte.
+      return 1;
+  }
+}
+
+// Returns the size of the report for the `command`, including the report
+// status byte, that starts at `report` with `len` bytes remaining. Reports of
+// unknown sizes take all remaining bytes. Returns 0 if the report doesn't fit.
+static uint8_t getReportSize(const uint8_t* command,
+                             const uint8_t* report,
+                             uint8_t len) {
+  if (!len) {
+    return 0;
+  }
+  if (report[0] != kReportOk) {
+    return 1;
+  }
+  uint16_t size = getFixedReportSize(command);
+  if (size) {
+    return (size <= len) ? size : 0;
+  }
+  switch (*command) {
+    case kCmdIoId:
+      // IoId report ends with a null character.
+      size = 1;
+      while (size < len && report[size]) {
+        size++;
+      }
+      size++;
+      break;
+    case kCmdFunctionCheck:
+      // FunctionCheck report contains 4-bytes entries followed by a
+      // terminator.
+      size = 1;
+      while (size < len && report[size]) {
+        size += 4;
+      }
+      size++;
+      break;
+    default:
+      size = len;
+      break;
+  }
+  return (size <= len) ? size : 0;
+}
+
+#if defined(JVSIO_HOST_QUEUE)
+// Returns the size of reports that the device replies to the `command` of
+// `len` bytes with, or kUnknownReportBytes if it depends on reports.
+static uint8_t getExpectedReportBytes(const uint8_t* command, uint8_t len) {
+  uint16_t bytes = 0;
+  while (len) {
+    uint8_t command_size;
+    uint16_t report_size = getFixedReportSize(command);
+    if (!report_size || !getCommandSize(command, len, &command_size) ||
+        !command_size || command_size > len) {
+      return kUnknownReportBytes;
+    }
+    bytes += report_size;
+    command += command_size;
+    len -= command_size;
+  }
+  return (bytes < kUnknownReportBytes) ? bytes : kUnknownReportBytes;
+}
+#endif
+
+static void functionChecked(uint8_t* data, uint8_t len) {
+  if (target <= JVSIO_HOST_DEVICE_MAX) {
+    // Capabilities are not tracked for devices beyond JVSIO_HOST_DEVICE_MAX.
+#if defined(JVSIO_HOST_OUTPUT)
+    gpo_bytes[target - 1] = 0;
+    analog_channels[target - 1] = 0;
+#endif
+    for (uint8_t i = 0; i < len; i += 4) {
+      switch (data[i]) {
+        case 0x01:
+          players[target - 1] = data[i + 1];
+          buttons[target - 1] = data[i + 2];
+          total_player += data[i + 1];
+          if (total_player > kPlayerMax)
+            total_player = kPlayerMax;
+          break;
+        case 0x02:
+          coin_slots[target - 1] = data[i + 1];
+          break;
+#if defined(JVSIO_HOST_OUTPUT)
+        case 0x12:
+          gpo_bytes[target - 1] = (data[i + 1] + 7) >> 3;
+          if (gpo_bytes[target - 1] > JVSIO_HOST_OUTPUT_GPO_SIZE)
+            gpo_bytes[target - 1] = JVSIO_HOST_OUTPUT_GPO_SIZE;
+          break;
+        case 0x13:
+          analog_channels[target - 1] = data[i + 1];
+          if (analog_channels[target - 1] > JVSIO_HOST_OUTPUT_ANALOG_CHANNELS)
+            analog_channels[target - 1] = JVSIO_HOST_OUTPUT_ANALOG_CHANNELS;
+          break;
+#endif
+        default:
+          break;
+      }
+    }
+#if defined(JVSIO_HOST_EVENTS)
+    memset(last_sw[target - 1], 0, sizeof(last_sw[0]));
+    memset(last_coin[target - 1], 0, sizeof(last_coin[0]));
+#endif
+#if defined(JVSIO_HOST_OUTPUT)
+    // The device may lose outputs on reset. Send the latest ones again.
+    output_dirty[target - 1] = kOutputGpo | kOutputAnalog;
+#endif
+  }
+  JVSIO_Client_functionCheckReceived(target, data, len);
+  if (target != devices) {
+    state = kStateRequestIoId;
+    target++;
+    batching = batch_enumeration;
+  } else {
+    state = kStateReady;
+  }
+}
+
+#if defined(JVSIO_HOST_CACHE)
+static struct JVSIO_DeviceCache* getCache(void) {
+  return (target <= JVSIO_HOST_DEVICE_MAX) ? &cache[target - 1] : NULL;
+}
+
+// Returns true if the cached entry for the target matches with the `io_id`,
+// and notifies all cached results. Otherwise, starts a new entry.
+static bool useCache(uint8_t* io_id, uint8_t len) {
+  struct JVSIO_DeviceCache* entry = getCache();
+  if (!entry) {
+    return false;
+  }
+  if (entry->function_check_len && entry->io_id_len == len &&
+      !memcmp(entry->io_id, io_id, len)) {
+    JVSIO_Client_commandRevReceived(target, entry->command_rev);
+    JVSIO_Client_jvRevReceived(target, entry->jv_rev);
+    JVSIO_Client_protocolVerReceived(target, entry->protocol_ver);
+    functionChecked(entry->function_check, entry->function_check_len);
+    return true;
+  }
+  entry->function_check_len = 0;
+  entry->io_id_len = (len <= sizeof(entry->io_id)) ? len : 0;
+  memcpy(entry->io_id, io_id, entry->io_id_len);
+  return false;
+}
+
+static void updateCache(uint8_t* function_check, uint8_t len) {
+  struct JVSIO_DeviceCache* entry = getCache();
+  if (!entry || !entry->io_id_len || len > sizeof(entry->function_check)) {
+    return;
+  }
+  entry->function_check_len = len;
+  memcpy(entry->function_check, function_check, len);
+  JVSIO_Client_deviceCacheUpdated(target, entry);
+}
+#endif
+
+// Starts reading reports in the response for the request in `tx_data`.
+static bool beginReports(struct JVSIO_ReportReader* reader,
+                         uint8_t* status,
+                         uint8_t len) {
+  return JVSIO_Host_beginReports(reader, &tx_data[2], tx_data[1] - 1, status,
+                                 len);
+}
+
+// Splits the response for a batched identification request into each report,
+// and notifies them. Returns false without any notification if the response
+// is malformed.
+static bool enumerated(uint8_t* status, uint8_t len) {
+  struct JVSIO_ReportReader reader;
+  uint8_t* reports[kEnumerationCommands];
+  uint8_t sizes[kEnumerationCommands];
+  if (!beginReports(&reader, status, len)) {
+    return false;
+  }
+  for (uint8_t i = 0; i < kEnumerationCommands; ++i) {
+    reports[i] = JVSIO_Host_nextReport(&reader, &sizes[i]);
+    if (!reports[i] || reports[i][0] != kReportOk) {
+      return false;
+    }
+  }
+  if (!JVSIO_Host_endReports(&reader)) {
+    return false;
+  }
+
+  // Reports are in order of IoId, CommandRev, JvRev, ProtocolVer, and
+  // FunctionCheck.
+  JVSIO_Client_ioIdReceived(target, &reports[0][1], sizes[0] - 1);
+  JVSIO_Client_commandRevReceived(target, reports[1][1]);
+  JVSIO_Client_jvRevReceived(target, reports[2][1]);
+  JVSIO_Client_protocolVerReceived(target, reports[3][1]);
+  functionChecked(&reports[4][1], sizes[4] - 1);
+  return true;
+}
+
+#if defined(JVSIO_HOST_OUTPUT)
+// Appends output commands for changed outputs to the sync request at `size`,
+// and returns the new size.
+static uint8_t appendOutputs(uint8_t index, uint8_t size) {
+  output_sent = output_dirty[index];
+  if (!gpo_bytes[index]) {
+    output_sent &= ~kOutputGpo;
+  }
+  if (!analog_channels[index]) {
+    output_sent &= ~kOutputAnalog;
+  }
+  output_dirty[index] &= ~output_sent;
+  if (output_sent & kOutputGpo) {
+    tx_data[size++] = kCmdDriverOutput;
+    tx_data[size++] = gpo_bytes[index];
+    for (uint8_t i = 0; i < gpo_bytes[index]; ++i) {
+      tx_data[size++] = gpo[index][i];
+    }
+  }
+  if (output_sent & kOutputAnalog) {
+    tx_data[size++] = kCmdAnalogOutput;
+    tx_data[size++] = analog_channels[index];
+    for (uint8_t i = 0; i < analog_channels[index]; ++i) {
+      tx_data[size++] = analog[index][i] >> 8;
+      tx_data[size++] = analog[index][i];
+    }
   }
+  return size;
+}
 
-  address[0] = kHostAddress;
+static uint8_t getOutputReports(void) {
+  return ((output_sent & kOutputGpo) ? 1 : 0) +
+         ((output_sent & kOutputAnalog) ? 1 : 0);
+}
+
+// Checks reports for output commands, and sends them again in the next sync
+// if they failed.
+static void outputSynced(uint8_t index, uint8_t* reports) {
+  if ((output_sent & kOutputGpo) && *reports++ != kReportOk) {
+    output_dirty[index] |= kOutputGpo;
+  }
+  if ((output_sent & kOutputAnalog) && *reports != kReportOk) {
+    output_dirty[index] |= kOutputAnalog;
+  }
+}
+#endif
+
+#if defined(JVSIO_HOST_EVENTS)
+static void pushInputEvent(uint32_t now,
+                           uint8_t type,
+                           uint8_t player,
+                           uint8_t index) {
+  if (event_size == JVSIO_HOST_EVENT_QUEUE_SIZE) {
+    return;
+  }
+  uint8_t tail = (event_head + event_size++) % JVSIO_HOST_EVENT_QUEUE_SIZE;
+  struct JVSIO_InputEvent* event = &events[tail];
+  event->tick = now;
+  event->address = target;
+  event->type = type;
+  event->player = player;
+  event->index = index;
+}
+
+// Compares switch bytes starting with the system byte, and coin counts with
+// the last ones, and queues events for changes.
+static void detectInputEvents(uint8_t index,
+                              uint8_t* sw,
+                              uint8_t sw_bytes,
+                              uint8_t button_bytes,
+                              uint8_t* coin,
+                              uint8_t coin_slots) {
+  uint32_t now = JVSIO_Client_getTick();
+  uint8_t* last = last_sw[index];
+  if (sw_bytes > JVSIO_HOST_EVENT_SWITCH_BYTES) {
+    sw_bytes = JVSIO_HOST_EVENT_SWITCH_BYTES;
+  }
+  for (uint8_t i = 0; i < sw_bytes; ++i) {
+    uint8_t diff = sw[i] ^ last[i];
+    if (!diff) {
+      continue;
+    }
+    uint8_t player = 0;
+    uint8_t base = 0;
+    if (i) {
+      player = 1 + (i - 1) / button_bytes;
+      base = ((i - 1) % button_bytes) << 3;
+    }
+    for (uint8_t bit = 0; diff; ++bit, diff <<= 1) {
+      if (diff & 0x80) {
+        uint8_t type = (sw[i] & (0x80 >> bit)) ? kInputPress : kInputRelease;
+        pushInputEvent(now, type, player, base + bit);
+      }
+    }
+    last[i] = sw[i];
+  }
+  if (coin_slots > JVSIO_HOST_EVENT_COIN_SLOTS) {
+    coin_slots = JVSIO_HOST_EVENT_COIN_SLOTS;
+  }
+  for (uint8_t slot = 0; slot < coin_slots; ++slot, coin += 2) {
+    uint16_t count = ((coin[0] << 8) | coin[1]) & 0x3fff;
+    uint16_t last_count = last_coin[index][slot];
+    last_coin[index][slot] = count;
+    if (count > last_count) {
+      count -= last_count;
+      pushInputEvent(now, kInputCoin, slot + 1, (count > 255) ? 255 : count);
+    }
+  }
+}
+#endif
+
+static uint8_t getPlayerIndex(uint8_t index) {
+  uint8_t player_index = 0;
+  for (uint8_t i = 0; i < index; ++i) {
+    player_index += players[i];
+  }
+  return player_index;
+}
+
+// Continues the sync from the device at `next`, and skips degraded devices
+// except for rounds to probe them. Notifies the client after the last device.
+static void syncFrom(uint8_t next) {
+  for (; next <= getSyncDevices(); ++next) {
+    if (!degraded[next - 1] || !(sync_round % JVSIO_HOST_DEGRADED_INTERVAL)) {
+      state = kStateRequestSync;
+      target = next;
+      return;
+    }
+  }
+  syncing = false;
+  state = kStateReady;
+  JVSIO_Client_synced(total_player, coin_state, sw_state0, sw_state1);
+}
+
+static void startSync(void) {
+  syncing = true;
+  sync_round++;
+  syncFrom(1);
+}
+
+// Handles a failure of the `target` device in the sync by retrying the sync,
+// querying the device, and marking it as degraded in turn. Returns false if
+// the bus should be reset.
+static bool recoverSync(void) {
+  if (!syncing || !JVSIO_Client_isSenseReady()) {
+    return false;
+  }
+  uint8_t index = target - 1;
+#if defined(JVSIO_HOST_OUTPUT)
+  output_dirty[index] |= output_sent;
+  output_sent = 0;
+#endif
+  if (degraded[index]) {
+    syncFrom(target + 1);
+  } else if (sync_errors[index] < JVSIO_HOST_SYNC_RETRIES) {
+    sync_errors[index]++;
+    state = kStateRequestSync;
+  } else if (sync_errors[index] == JVSIO_HOST_SYNC_RETRIES) {
+    sync_errors[index]++;
+    state = kStateRequestRecovery;
+  } else {
+    JVSIO_Client_dump("DEGRADED", &target, 1);
+    degraded[index] = true;
+    sync_errors[index] = 0;
+    uint8_t player_index = getPlayerIndex(index);
+    for (uint8_t player = 0; player < players[index] &&
+                             (player_index + player) < kPlayerMax;
+         ++player) {
+      sw_state0[player_index + player] = 0;
+      sw_state1[player_index + player] = 0;
+    }
+#if defined(JVSIO_HOST_EVENTS)
+    // Release switches that are held, and let the first sync after the
+    // recovery compare with the released state.
+    uint8_t released[JVSIO_HOST_EVENT_SWITCH_BYTES];
+    uint8_t button_bytes = (buttons[index] + 7) >> 3;
+    memset(released, 0, sizeof(released));
+    detectInputEvents(index, released, 1 + button_bytes * players[index],
+                      button_bytes, NULL, 0);
+#endif
+    syncFrom(target + 1);
+  }
+  return true;
+}
+
+#if defined(JVSIO_HOST_QUEUE)
+static bool isBefore(uint32_t a, uint32_t b) {
+  return (int32_t)(a - b) < 0;
+}
+
+// Sends the prebuilt `frame` of `len` bytes as is, and returns the size of
+// reports that the response is expected to contain.
+static uint8_t sendFrame(const uint8_t* frame, uint8_t len) {
+  JVSIO_Client_willSend();
+#if defined(JVSIO_BULK_IO)
+  JVSIO_Client_sendBytes(frame, len);
+#else
+  for (uint8_t i = 0; i < len; ++i) {
+    JVSIO_Client_send(frame[i]);
+  }
+#endif
+  JVSIO_Client_willReceive();
+
+  // Unescape the frame into `tx_data` to see commands.
+  uint8_t size = 0;
+  bool escaping = false;
+  for (uint8_t i = 1; i < len; ++i) {
+    if (frame[i] == kMarker) {
+      escaping = true;
+      continue;
+    }
+    tx_data[size++] = escaping ? (frame[i] + 1) : frame[i];
+    escaping = false;
+  }
+  if (size < 4 || size != (tx_data[1] + 2u)) {
+    return kUnknownReportBytes;
+  }
+  return getExpectedReportBytes(&tx_data[2], tx_data[1] - 1);
+}
+
+// Sends the most prioritized transaction in the queue. Returns false if the
+// queue is empty.
+static bool sendTransaction(void) {
+  uint32_t now = JVSIO_Client_getTick();
+  struct Transaction* next = NULL;
+  for (uint8_t i = 0; i < JVSIO_HOST_QUEUE_SIZE; ++i) {
+    struct Transaction* transaction = &queue[i];
+    if (!transaction->id) {
+      continue;
+    }
+    if (isBefore(transaction->deadline, now)) {
+      uint8_t id = transaction->id;
+      transaction->id = 0;
+      JVSIO_Client_transactionCompleted(id, NULL, 0);
+      continue;
+    }
+    if (!next || transaction->priority < next->priority ||
+        (transaction->priority == next->priority &&
+         isBefore(transaction->deadline, next->deadline))) {
+      next = transaction;
+    }
+  }
+  if (!next) {
+    return false;
+  }
+  // Sync requests that come in the meantime wait for the response. Let the
+  // timeout follow the expected response size so that devices that don't
+  // reply delay them as short as the sync timeout.
+  if (next->frame) {
+    startTimeout(sendFrame(next->frame, next->len));
+  } else {
+    tx_data[0] = next->address;
+    tx_data[1] = next->len + 1;
+    memcpy(&tx_data[2], next->command, next->len);
+    sendRequest(getExpectedReportBytes(next->command, next->len));
+  }
+  transaction_id = next->id;
+  next->id = 0;
+  return true;
+}
+
+static void completeTransaction(uint8_t* status, uint8_t len) {
+  JVSIO_Client_transactionCompleted(transaction_id, status, len);
+  if (sync_pending) {
+    sync_pending = false;
+    startSync();
+  } else {
+    state = kStateReady;
+  }
+}
+#endif
+
+static uint8_t* receiveStatus(uint8_t* len) {
   receive(false);
-  if (rx_error || !rx_available)
+  if (rx_error || !rx_available) {
+#if defined(JVSIO_MICROSECOND_TICK)
+    if (!timeInRange(request_tick, JVSIO_Client_getMicroseconds(), timeout))
+#else
+    if (!timeInRange(tick, JVSIO_Client_getTick(), timeout))
+#endif
+      state = kStateTimeout;
     return NULL;
+  }
 
   *len = rx_data[1] - 1;
   rx_size = 0;
@@ -85,6 +677,27 @@ static uint8_t* receiveStatus(uint8_t* len) {
   return &rx_data[2];
 }
 
+// Receives the response that contains a report for the single command in
+// `tx_data`, and returns the report data that follows the report status byte.
+// Returns NULL if the response is not available yet, or is invalid.
+static uint8_t* receiveReport(uint8_t* len) {
+  struct JVSIO_ReportReader reader;
+  uint8_t status_len;
+  uint8_t* report;
+  uint8_t* status = receiveStatus(&status_len);
+  if (!status) {
+    return NULL;
+  }
+  if (!beginReports(&reader, status, status_len) ||
+      !(report = JVSIO_Host_nextReport(&reader, len)) ||
+      !JVSIO_Host_endReports(&reader) || report[0] != kReportOk) {
+    state = kStateInvalidResponse;
+    return NULL;
+  }
+  (*len)--;
+  return &report[1];
+}
+
 void JVSIO_Host_init(void) {
   state = kStateDisconnected;
   rx_size = 0;
@@ -94,8 +707,32 @@ void JVSIO_Host_init(void) {
   rx_available = false;
   rx_error = false;
   tx_report_size = 0;
-  nodes = 1;
-  address[0] = kBroadcastAddress;
+  resetAddresses();
+  assignAddress(0, kHostAddress);
+  batch_enumeration = false;
+  syncing = false;
+  sync_round = 0;
+#if !defined(JVSIO_COMM_115200_ONLY)
+  comm_mode = k115200;
+#endif
+#if defined(JVSIO_HOST_OUTPUT)
+  memset(gpo_bytes, 0, sizeof(gpo_bytes));
+  memset(gpo, 0, sizeof(gpo));
+  memset(analog_channels, 0, sizeof(analog_channels));
+  memset(analog, 0, sizeof(analog));
+  memset(output_dirty, 0, sizeof(output_dirty));
+#endif
+#if defined(JVSIO_HOST_EVENTS)
+  event_head = 0;
+  event_size = 0;
+#endif
+#if defined(JVSIO_HOST_QUEUE)
+  memset(queue, 0, sizeof(queue));
+  sync_pending = false;
+#endif
+#if defined(JVSIO_HOST_CACHE)
+  memset(cache, 0, sizeof(cache));
+#endif
 
   JVSIO_Client_willReceive();
 }
@@ -104,6 +741,10 @@ bool JVSIO_Host_run(void) {
   uint8_t* status = 0;
   uint8_t status_len = 0;
   bool connected = JVSIO_Client_isSenseConnected();
+#if defined(JVSIO_HOST_QUEUE)
+  if (!connected && state == kStateWaitTransactionResponse)
+    completeTransaction(NULL, 0);
+#endif
   if (!connected)
     state = kStateDisconnected;
 
@@ -128,12 +769,13 @@ bool JVSIO_Host_run(void) {
       tx_data[1] = 3;  // Bytes
       tx_data[2] = kCmdReset;
       tx_data[3] = 0xd9;  // Magic number.
-      JVSIO_Client_willSend();
-      sendPacket();
-      tick = JVSIO_Client_getTick();
+      sendRequest(0);
       devices = 0;
       total_player = 0;
       coin_state = 0;
+      syncing = false;
+      memset(sync_errors, 0, sizeof(sync_errors));
+      memset(degraded, 0, sizeof(degraded));
       break;
     case kStateAddress:
       if (devices == 255) {
@@ -144,18 +786,11 @@ bool JVSIO_Host_run(void) {
       tx_data[1] = 3;  // Bytes
       tx_data[2] = kCmdAddressSet;
       tx_data[3] = ++devices;
-      JVSIO_Client_willSend();
-      sendPacket();
-      tick = JVSIO_Client_getTick();
+      sendRequest(1);
       break;
     case kStateAddressWaitResponse:
-      status = receiveStatus(&status_len);
-      if (!status)
-        return false;
-      if (status_len != 2 || status[0] != 1 || status[1] != 1) {
-        state = kStateInvalidResponse;
+      if (!receiveReport(&status_len))
         return false;
-      }
       tick = JVSIO_Client_getTick();
       break;
     case kStateReadyCheck:
@@ -167,135 +802,145 @@ bool JVSIO_Host_run(void) {
         return false;
       }
       target = 1;
+      batching = batch_enumeration;
       break;
     case kStateRequestIoId:
+      if (batching) {
+        tx_data[0] = target;
+        tx_data[1] = 6;  // Bytes
+        tx_data[2] = kCmdIoId;
+        tx_data[3] = kCmdCommandRev;
+        tx_data[4] = kCmdJvRev;
+        tx_data[5] = kCmdProtocolVer;
+        tx_data[6] = kCmdFunctionCheck;
+        sendRequest(kUnknownReportBytes);
+        state = kStateWaitEnumerationResponse;
+        return false;
+      }
       tx_data[0] = target;
       tx_data[1] = 2;  // Bytes
       tx_data[2] = kCmdIoId;
-      JVSIO_Client_willSend();
-      sendPacket();
-      tick = JVSIO_Client_getTick();
+      sendRequest(kUnknownReportBytes);
       break;
     case kStateWaitIoIdResponse:
-      status = receiveStatus(&status_len);
+      status = receiveReport(&status_len);
       if (!status)
         return false;
-      if (status_len < 3 || status[0] != 1 || status[1] != 1) {
-        state = kStateInvalidResponse;
+      JVSIO_Client_ioIdReceived(target, status, status_len);
+#if defined(JVSIO_HOST_CACHE)
+      if (useCache(status, status_len)) {
         return false;
       }
-      JVSIO_Client_ioIdReceived(target, &status[2], status_len - 2);
+#endif
       break;
     case kStateRequestCommandRev:
       tx_data[0] = target;
       tx_data[1] = 2;  // Bytes
       tx_data[2] = kCmdCommandRev;
-      JVSIO_Client_willSend();
-      sendPacket();
-      tick = JVSIO_Client_getTick();
+      sendRequest(2);
       break;
     case kStateWaitCommandRevResponse:
-      status = receiveStatus(&status_len);
+      status = receiveReport(&status_len);
       if (!status)
         return false;
-      if (status_len != 3 || status[0] != 1 || status[1] != 1) {
-        state = kStateInvalidResponse;
-        return false;
+      JVSIO_Client_commandRevReceived(target, status[0]);
+#if defined(JVSIO_HOST_CACHE)
+      if (getCache()) {
+        getCache()->command_rev = status[0];
       }
-      JVSIO_Client_commandRevReceived(target, status[2]);
+#endif
       break;
     case kStateRequestJvRev:
       tx_data[0] = target;
       tx_data[1] = 2;  // Bytes
       tx_data[2] = kCmdJvRev;
-      JVSIO_Client_willSend();
-      sendPacket();
-      tick = JVSIO_Client_getTick();
+      sendRequest(2);
       break;
     case kStateWaitJvRevResponse:
-      status = receiveStatus(&status_len);
+      status = receiveReport(&status_len);
       if (!status)
         return false;
-      if (status_len != 3 || status[0] != 1 || status[1] != 1) {
-        state = kStateInvalidResponse;
-        return false;
+      JVSIO_Client_jvRevReceived(target, status[0]);
+#if defined(JVSIO_HOST_CACHE)
+      if (getCache()) {
+        getCache()->jv_rev = status[0];
       }
-      JVSIO_Client_jvRevReceived(target, status[2]);
+#endif
       break;
     case kStateRequestProtocolVer:
       tx_data[0] = target;
       tx_data[1] = 2;  // Bytes
       tx_data[2] = kCmdProtocolVer;
-      JVSIO_Client_willSend();
-      sendPacket();
-      tick = JVSIO_Client_getTick();
+      sendRequest(2);
       break;
     case kStateWaitProtocolVerResponse:
-      status = receiveStatus(&status_len);
+      status = receiveReport(&status_len);
       if (!status)
         return false;
-      if (status_len != 3 || status[0] != 1 || status[1] != 1) {
-        state = kStateInvalidResponse;
-        return false;
+      JVSIO_Client_protocolVerReceived(target, status[0]);
+#if defined(JVSIO_HOST_CACHE)
+      if (getCache()) {
+        getCache()->protocol_ver = status[0];
       }
-      JVSIO_Client_protocolVerReceived(target, status[2]);
+#endif
       break;
     case kStateRequestFunctionCheck:
       tx_data[0] = target;
       tx_data[1] = 2;  // Bytes
       tx_data[2] = kCmdFunctionCheck;
-      JVSIO_Client_willSend();
-      sendPacket();
-      tick = JVSIO_Client_getTick();
+      sendRequest(kUnknownReportBytes);
       break;
     case kStateWaitFunctionCheckResponse:
-      status = receiveStatus(&status_len);
+      status = receiveReport(&status_len);
       if (!status)
         return false;
-      if (status_len < 3 || status[0] != 1 || status[1] != 1) {
-        state = kStateInvalidResponse;
+#if defined(JVSIO_HOST_CACHE)
+      updateCache(status, status_len);
+#endif
+      functionChecked(status, status_len);
+      return false;
+    case kStateWaitEnumerationResponse:
+      status = receiveStatus(&status_len);
+      if (!status && state == kStateTimeout) {
+        // The device may ignore packets that contain multiple commands.
+        batching = false;
+        state = kStateRequestIoId;
         return false;
       }
-      if (target <= 4) {
-        // Doesn't support 5+ devices.
-        for (uint8_t i = 2; i < status_len; i += 4) {
-          switch (status[i]) {
-            case 0x01:
-              players[target - 1] = status[i + 1];
-              buttons[target - 1] = status[i + 2];
-              total_player += status[i + 1];
-              if (total_player > 4)
-                total_player = 4;
-              break;
-            case 0x02:
-              coin_slots[target - 1] = status[i + 1];
-              break;
-            default:
-              break;
-          }
-        }
-      }
-      JVSIO_Client_functionCheckReceived(target, &status[2], status_len - 2);
-      if (target != devices) {
-        state = kStateRequestIoId;
-        target++;
+      if (!status)
         return false;
+      if (!enumerated(status, status_len)) {
+        // The device may not accept multiple commands in a packet. Fall back
+        // to identify it by one command per packet.
+        batching = false;
+        state = kStateRequestIoId;
       }
-      break;
+      return false;
     case kStateReady:
+#if defined(JVSIO_HOST_QUEUE)
+      if (sendTransaction()) {
+        state = kStateWaitTransactionResponse;
+        return false;
+      }
+#endif
       return true;
     case kStateRequestSync: {
       uint8_t target_index = target - 1;
+      uint8_t size = 7;
       tx_data[0] = target;
-      tx_data[1] = 6;  // Bytes
       tx_data[2] = kCmdSwInput;
       tx_data[3] = players[target_index];
       tx_data[4] = (buttons[target_index] + 7) >> 3;
       tx_data[5] = kCmdCoinInput;
       tx_data[6] = coin_slots[target_index];
-      JVSIO_Client_willSend();
-      sendPacket();
-      tick = JVSIO_Client_getTick();
+      uint8_t report_bytes = 3 + players[target_index] * tx_data[4] +
+                             coin_slots[target_index] * 2;
+#if defined(JVSIO_HOST_OUTPUT)
+      size = appendOutputs(target_index, size);
+      report_bytes += getOutputReports();
+#endif
+      tx_data[1] = size - 1;  // Bytes
+      sendRequest(report_bytes);
       break;
     }
     case kStateWaitSyncResponse: {
@@ -304,31 +949,65 @@ bool JVSIO_Host_run(void) {
         return false;
       uint8_t target_index = target - 1;
       uint8_t button_bytes = (buttons[target_index] + 7) >> 3;
-      uint8_t sw_bytes = 1 + button_bytes * players[target_index];
-      uint8_t coin_bytes = coin_slots[target_index] * 2;
-      uint8_t status_bytes = 3 + sw_bytes + coin_bytes;
-      if (status_len != status_bytes || status[0] != 1 || status[1] != 1 ||
-          status[2 + sw_bytes] != 1) {
+      struct JVSIO_ReportReader reader;
+      uint8_t size;
+      uint8_t* sw = NULL;
+      uint8_t* coin = NULL;
+      if (beginReports(&reader, status, status_len)) {
+        sw = JVSIO_Host_nextReport(&reader, &size);
+        coin = JVSIO_Host_nextReport(&reader, &size);
+      }
+#if defined(JVSIO_HOST_OUTPUT)
+      // Output reports follow, and contain only the status byte.
+      uint8_t* outputs = reader.report;
+      while (JVSIO_Host_nextReport(&reader, &size))
+        ;
+#endif
+      if (!sw || sw[0] != kReportOk || !coin || coin[0] != kReportOk ||
+          !JVSIO_Host_endReports(&reader)) {
         state = kStateInvalidResponse;
         return false;
       }
-      uint8_t player_index = 0;
-      for (uint8_t i = 0; i < target_index; ++i) {
-        player_index += players[target_index];
-      }
-      coin_state |= status[2] & 0x80;
-      for (uint8_t player = 0; player < players[target_index]; ++player) {
-        sw_state0[player_index + player] = status[3 + button_bytes * player];
-        sw_state1[player_index + player] = status[4 + button_bytes * player];
+      sw++;
+      coin++;
+#if defined(JVSIO_HOST_OUTPUT)
+      outputSynced(target_index, outputs);
+#endif
+#if defined(JVSIO_HOST_EVENTS)
+      detectInputEvents(target_index, sw,
+                        1 + button_bytes * players[target_index], button_bytes,
+                        coin, coin_slots[target_index]);
+#endif
+#if defined(JVSIO_HOST_SYNC_REPORT)
+      struct JVSIO_SyncReport report;
+      report.data = status;
+      report.len = status_len;
+      report.players = players[target_index];
+      report.switch_bytes = button_bytes;
+      report.coin_slots = coin_slots[target_index];
+      report.switch_offset = sw - status;
+      report.coin_offset = coin - status;
+      JVSIO_Client_syncReceived(target, &report);
+#endif
+      sync_errors[target_index] = 0;
+      degraded[target_index] = false;
+      uint8_t player_index = getPlayerIndex(target_index);
+      coin_state |= sw[0] & 0x80;
+      for (uint8_t player = 0; player < players[target_index] &&
+                               (player_index + player) < kPlayerMax;
+           ++player) {
+        sw_state0[player_index + player] = sw[1 + button_bytes * player];
+        sw_state1[player_index + player] = sw[2 + button_bytes * player];
       }
-      for (uint8_t player = 0; player < coin_slots[target_index]; ++player) {
+      for (uint8_t player = 0; player < coin_slots[target_index] &&
+                               (player_index + player) < kPlayerMax;
+           ++player) {
         uint8_t mask = 1 << (player_index + player);
         if (coin_state & mask) {
           coin_state &= ~mask;
         } else {
-          uint8_t index = 3 + sw_bytes + player * 2;
-          uint16_t coin = (status[index] << 8) | status[index + 1];
-          if (coin & 0xc000 || coin == 0)
+          uint16_t count = (coin[player * 2] << 8) | coin[player * 2 + 1];
+          if (count & 0xc000 || count == 0)
             continue;
           coin_state |= mask;
           tx_data[0] = target;
@@ -337,40 +1016,54 @@ bool JVSIO_Host_run(void) {
           tx_data[3] = 1 + player;
           tx_data[4] = 0;
           tx_data[5] = 1;
-          JVSIO_Client_willSend();
-          sendPacket();
-          tick = JVSIO_Client_getTick();
+          sendRequest(1);
           state = kStateWaitCoinSyncResponse;
           return false;
         }
       }
-      if (target == devices) {
-        state = kStateReady;
-        JVSIO_Client_synced(total_player, coin_state, sw_state0, sw_state1);
-      } else {
-        state = kStateRequestSync;
-        target++;
-      }
+      syncFrom(target + 1);
       return false;
     }
     case kStateWaitCoinSyncResponse:
-      status = receiveStatus(&status_len);
-      if (!status)
-        return false;
-      if (status_len != 2 || status[0] != 1 || status[1] != 1) {
-        state = kStateInvalidResponse;
+      if (!receiveReport(&status_len))
         return false;
+#if defined(JVSIO_HOST_EVENTS)
+      // The device lowered the count by the CoinSub in `tx_data`.
+      if (tx_data[3] <= JVSIO_HOST_EVENT_COIN_SLOTS &&
+          last_coin[target - 1][tx_data[3] - 1]) {
+        last_coin[target - 1][tx_data[3] - 1]--;
       }
-      if (target == devices) {
-        state = kStateReady;
-        JVSIO_Client_synced(total_player, coin_state, sw_state0, sw_state1);
-      } else {
-        state = kStateRequestSync;
-        target++;
+#endif
+      syncFrom(target + 1);
+      return false;
+    case kStateRequestRecovery:
+      tx_data[0] = target;
+      tx_data[1] = 2;  // Bytes
+      tx_data[2] = kCmdIoId;
+      sendRequest(kUnknownReportBytes);
+      break;
+    case kStateWaitRecoveryResponse:
+      if (!receiveReport(&status_len))
+        return false;
+      // The device is still there. Retry the sync once more.
+      state = kStateRequestSync;
+      return false;
+#if defined(JVSIO_HOST_QUEUE)
+    case kStateWaitTransactionResponse:
+      status = receiveStatus(&status_len);
+      if (status) {
+        completeTransaction(status, status_len);
+      } else if (state == kStateTimeout) {
+        // Don't reset the bus as the command may be just unsupported.
+        completeTransaction(NULL, 0);
       }
       return false;
+#endif
     case kStateTimeout:
     case kStateInvalidResponse:
+      if (!recoverSync())
+        state = kStateDisconnected;
+      return false;
     case kStateUnexpected:
       state = kStateDisconnected;
       return false;
@@ -381,9 +1074,232 @@ bool JVSIO_Host_run(void) {
   return false;
 }
 
+enum JVSIO_HostWait JVSIO_Host_getWait(uint32_t* next_tick) {
+  // timeInRange() returns false at the tick after `duration`.
+  switch (state) {
+    case kStateDisconnected:
+      return JVSIO_Client_isSenseConnected() ? kHostWaitNone
+                                             : kHostWaitConnection;
+    case kStateConnected:
+    case kStateResetWaitInterval:
+      *next_tick = tick + kResetInterval + 1;
+      return kHostWaitTimer;
+    case kStateReadyCheck:
+      *next_tick = tick + 2 + 1;
+      return kHostWaitSense;
+    case kStateAddressWaitResponse:
+    case kStateWaitIoIdResponse:
+    case kStateWaitCommandRevResponse:
+    case kStateWaitJvRevResponse:
+    case kStateWaitProtocolVerResponse:
+    case kStateWaitFunctionCheckResponse:
+    case kStateWaitEnumerationResponse:
+    case kStateWaitSyncResponse:
+    case kStateWaitCoinSyncResponse:
+    case kStateWaitRecoveryResponse:
+    case kStateWaitTransactionResponse: {
+#if defined(JVSIO_MICROSECOND_TICK)
+      uint32_t elapsed = JVSIO_Client_getMicroseconds() - request_tick;
+      uint32_t rest = (elapsed < timeout) ? (timeout - elapsed) : 0;
+      *next_tick = JVSIO_Client_getTick() + (rest + 999) / 1000 + 1;
+#else
+      *next_tick = tick + timeout + 1;
+#endif
+      return kHostWaitData;
+    }
+    case kStateReady:
+#if defined(JVSIO_HOST_QUEUE)
+      for (uint8_t i = 0; i < JVSIO_HOST_QUEUE_SIZE; ++i) {
+        if (queue[i].id) {
+          return kHostWaitNone;
+        }
+      }
+#endif
+      return kHostWaitRequest;
+    default:
+      return kHostWaitNone;
+  }
+}
+
+#if defined(JVSIO_HOST_OUTPUT)
+void JVSIO_Host_setGeneralPurposeOutput(uint8_t address,
+                                        const uint8_t* data,
+                                        uint8_t len) {
+  if (address == 0 || address > JVSIO_HOST_DEVICE_MAX) {
+    return;
+  }
+  uint8_t index = address - 1;
+  if (len > JVSIO_HOST_OUTPUT_GPO_SIZE) {
+    len = JVSIO_HOST_OUTPUT_GPO_SIZE;
+  }
+  if (memcmp(gpo[index], data, len)) {
+    memcpy(gpo[index], data, len);
+    output_dirty[index] |= kOutputGpo;
+  }
+}
+
+void JVSIO_Host_setAnalogOutput(uint8_t address,
+                                uint8_t channel,
+                                uint16_t value) {
+  if (address == 0 || address > JVSIO_HOST_DEVICE_MAX ||
+      channel >= JVSIO_HOST_OUTPUT_ANALOG_CHANNELS) {
+    return;
+  }
+  uint8_t index = address - 1;
+  if (analog[index][channel] != value) {
+    analog[index][channel] = value;
+    output_dirty[index] |= kOutputAnalog;
+  }
+}
+#endif
+
+#if defined(JVSIO_HOST_EVENTS)
+bool JVSIO_Host_popInputEvent(struct JVSIO_InputEvent* event) {
+  if (!event_size) {
+    return false;
+  }
+  *event = events[event_head];
+  event_head = (event_head + 1) % JVSIO_HOST_EVENT_QUEUE_SIZE;
+  event_size--;
+  return true;
+}
+#endif
+
+#if defined(JVSIO_HOST_CACHE)
+void JVSIO_Host_setDeviceCache(uint8_t address,
+                               const struct JVSIO_DeviceCache* entry) {
+  if (address == 0 || address > JVSIO_HOST_DEVICE_MAX) {
+    return;
+  }
+  if (entry->io_id_len > sizeof(entry->io_id) ||
+      entry->function_check_len > sizeof(entry->function_check)) {
+    // Ignore broken entries, e.g. ones read from a corrupted storage.
+    memset(&cache[address - 1], 0, sizeof(cache[0]));
+    return;
+  }
+  cache[address - 1] = *entry;
+}
+#endif
+
+bool JVSIO_Host_beginReports(struct JVSIO_ReportReader* reader,
+                             const uint8_t* command,
+                             uint8_t command_len,
+                             uint8_t* status,
+                             uint8_t len) {
+  reader->command = command;
+  reader->command_len = command_len;
+  reader->report = &status[1];
+  reader->report_len = len ? (len - 1) : 0;
+  return len && status[0] == 1;
+}
+
+uint8_t* JVSIO_Host_nextReport(struct JVSIO_ReportReader* reader,
+                               uint8_t* len) {
+  uint8_t command_size;
+  if (!reader->command_len ||
+      !getCommandSize(reader->command, reader->command_len, &command_size) ||
+      !command_size || command_size > reader->command_len) {
+    return NULL;
+  }
+  uint8_t report_size =
+      getReportSize(reader->command, reader->report, reader->report_len);
+  if (!report_size) {
+    return NULL;
+  }
+  uint8_t* report = reader->report;
+  reader->command += command_size;
+  reader->command_len -= command_size;
+  reader->report += report_size;
+  reader->report_len -= report_size;
+  *len = report_size;
+  return report;
+}
+
+bool JVSIO_Host_endReports(const struct JVSIO_ReportReader* reader) {
+  return !reader->command_len && !reader->report_len;
+}
+
+#if !defined(JVSIO_COMM_115200_ONLY)
+void JVSIO_Host_setCommSupMode(enum JVSIO_CommSupMode mode) {
+  comm_mode = mode;
+}
+#endif
+
+void JVSIO_Host_setBatchEnumeration(bool enable) {
+  batch_enumeration = enable;
+}
+
+#if defined(JVSIO_HOST_QUEUE)
+// Takes an empty slot in the queue with a new id. Returns NULL if the queue is
+// full.
+static struct Transaction* queueTransaction(uint8_t priority,
+                                            uint32_t deadline) {
+  for (uint8_t i = 0; i < JVSIO_HOST_QUEUE_SIZE; ++i) {
+    struct Transaction* transaction = &queue[i];
+    if (transaction->id) {
+      continue;
+    }
+    if (++last_id == 0) {
+      last_id = 1;
+    }
+    transaction->id = last_id;
+    transaction->priority = priority;
+    transaction->deadline = deadline;
+    return transaction;
+  }
+  return NULL;
+}
+
+uint8_t JVSIO_Host_submit(uint8_t address,
+                          const uint8_t* command,
+                          uint8_t len,
+                          uint8_t priority,
+                          uint32_t deadline) {
+  if (!len || len > JVSIO_HOST_QUEUE_COMMAND_SIZE) {
+    return 0;
+  }
+  struct Transaction* transaction = queueTransaction(priority, deadline);
+  if (!transaction) {
+    return 0;
+  }
+  transaction->address = address;
+  transaction->len = len;
+  transaction->frame = NULL;
+  memcpy(transaction->command, command, len);
+  return transaction->id;
+}
+
+uint8_t JVSIO_Host_submitFrame(const uint8_t* frame,
+                               uint8_t len,
+                               uint8_t priority,
+                               uint32_t deadline) {
+  // SYNC, address, size, a command, and the checksum at least. The frame is
+  // unescaped into the send buffer to see commands.
+  if (len < 5 || len > sizeof(tx_data) || frame[0] != kSync) {
+    return 0;
+  }
+  struct Transaction* transaction = queueTransaction(priority, deadline);
+  if (!transaction) {
+    return 0;
+  }
+  transaction->len = len;
+  transaction->frame = frame;
+  return transaction->id;
+}
+#endif
+
 void JVSIO_Host_sync(void) {
+#if defined(JVSIO_HOST_QUEUE)
+  if (state == kStateWaitTransactionResponse) {
+    sync_pending = true;
+    return;
+  }
+#endif
   if (state != kStateReady)
     return;
-  state = kStateRequestSync;
-  target = 1;
+  startSync();
+}
+
+bool JVSIO_Host_isDegraded(uint8_t address) {
+  return address && address <= JVSIO_HOST_DEVICE_MAX && degraded[address - 1];
 }
@@ -6,9 +6,166 @@
 #define __JVSIO_HOST_H__
 
 #include <stdbool.h>
+#include <stdint.h>
+
+#include "jvsio_client.h"
+#include "jvsio_config.h"
 
 void JVSIO_Host_init(void);
 bool JVSIO_Host_run(void);
 void JVSIO_Host_sync(void);
 
+// Returns true if the device at `address` is marked as degraded for failing
+// syncs repeatedly. Inputs from it read as released until it recovers.
+bool JVSIO_Host_isDegraded(uint8_t address);
+
+enum JVSIO_HostWait {
+  kHostWaitNone,        // Run again without waiting.
+  kHostWaitTimer,       // Run at the tick.
+  kHostWaitData,        // Run on receiving data, or at the tick for timeout.
+  kHostWaitSense,       // Run on the sense ready, or at the tick.
+  kHostWaitConnection,  // Run on the sense connected.
+  kHostWaitRequest,     // Run after JVSIO_Host_sync() or JVSIO_Host_submit().
+};
+
+// Returns what JVSIO_Host_run() waits for next so that the client can sleep
+// until then instead of calling it in a busy loop, and sets the tick in
+// JVSIO_Client_getTick() to run at for kHostWaitTimer, kHostWaitData, and
+// kHostWaitSense. Running earlier is harmless. Disconnections should be
+// notified to JVSIO_Host_run() regardless.
+enum JVSIO_HostWait JVSIO_Host_getWait(uint32_t* tick);
+
+#if !defined(JVSIO_COMM_115200_ONLY)
+// Notifies the bus speed to estimate response timeouts. The host doesn't
+// change the speed by itself, and the client should call this after it
+// switches the speed for all devices.
+void JVSIO_Host_setCommSupMode(enum JVSIO_CommSupMode mode);
+#endif
+
+// Sends IoId, CommandRev, JvRev, ProtocolVer, and FunctionCheck in a packet
+// to identify each device in one round trip. Devices that don't reply to the
+// batched request are identified by one command per packet as usual.
+// JVSIO_HOST_CACHE doesn't take effect while this mode is enabled.
+void JVSIO_Host_setBatchEnumeration(bool enable);
+
+// Reads reports in a response in place, e.g. one that
+// JVSIO_Client_transactionCompleted() notifies. Each report size is computed
+// from the command that it replies to, and the report itself for
+// variable-length ones, e.g. IoId and FunctionCheck.
+struct JVSIO_ReportReader {
+  const uint8_t* command;
+  uint8_t command_len;
+  uint8_t* report;
+  uint8_t report_len;
+};
+
+// Starts reading reports in the response `status` of `len` bytes for the
+// `command` of `command_len` bytes, that may contain multiple commands.
+// Returns false if the response status is not OK.
+bool JVSIO_Host_beginReports(struct JVSIO_ReportReader* reader,
+                             const uint8_t* command,
+                             uint8_t command_len,
+                             uint8_t* status,
+                             uint8_t len);
+
+// Returns the report for the next command, that starts with the report status
+// byte, and sets the report size to `len`. The next command is available in
+// `reader->command` before the call. Reports that are not OK contain only the
+// report status byte. Returns NULL after the last report, or if the response
+// doesn't match with the commands.
+uint8_t* JVSIO_Host_nextReport(struct JVSIO_ReportReader* reader,
+                               uint8_t* len);
+
+// Returns true if all commands and reports are read without extra bytes.
+bool JVSIO_Host_endReports(const struct JVSIO_ReportReader* reader);
+
+#if defined(JVSIO_HOST_QUEUE)
+// Queues `command` of `len` bytes, that may contain multiple commands, to send
+// to the device at `address` while the host is ready. Pending syncs are always
+// prioritized so that queued commands delay input polls by one round trip at
+// most. The response timeout follows the size of reports for the commands, and
+// commands of unknown report sizes, e.g. IoId, wait longer. Queued commands
+// with a smaller `priority` value are sent first, and ones with the same
+// priority are sent in order of `deadline`. Commands that are not sent by the
+// `deadline` tick are dropped.
+// Returns an id to be passed to JVSIO_Client_transactionCompleted() with the
+// status and reports, or NULL status on drops and timeouts. Returns 0 if the
+// command can not be queued.
+uint8_t JVSIO_Host_submit(uint8_t address,
+                          const uint8_t* command,
+                          uint8_t len,
+                          uint8_t priority,
+                          uint32_t deadline);
+
+// Queues a prebuilt request `frame` of `len` bytes that starts with SYNC, and
+// contains escaped address, size, commands, and checksum bytes, e.g. one that
+// jvsio::BuildFrame() builds at compile time. The frame is sent as is without
+// being copied, and should be kept until the transaction completes. Others are
+// the same as JVSIO_Host_submit().
+uint8_t JVSIO_Host_submitFrame(const uint8_t* frame,
+                               uint8_t len,
+                               uint8_t priority,
+                               uint32_t deadline);
+#endif
+
+#if defined(JVSIO_HOST_OUTPUT)
+// Updates the general-purpose output bytes, or an analog output channel, of
+// the device at `address`. Outputs are sent within the next sync for the
+// device only when they are changed, and are sent again after reconnections.
+// Outputs that the device doesn't report in FunctionCheck are ignored.
+void JVSIO_Host_setGeneralPurposeOutput(uint8_t address,
+                                        const uint8_t* data,
+                                        uint8_t len);
+void JVSIO_Host_setAnalogOutput(uint8_t address,
+                                uint8_t channel,
+                                uint16_t value);
+#endif
+
+#if defined(JVSIO_HOST_EVENTS)
+enum JVSIO_InputEventType {
+  kInputRelease = 0,
+  kInputPress = 1,
+  kInputCoin = 2,
+};
+
+// An input change that a sync found. `tick` is JVSIO_Client_getTick() when the
+// response arrived. For switches, `player` is 0 for the system byte, or 1 for
+// the first player, and `index` is the bit position from the MSB of the first
+// byte for the player. For coins, `player` is 1 for the first slot, and
+// `index` is the increased count.
+struct JVSIO_InputEvent {
+  uint32_t tick;
+  uint8_t address;
+  uint8_t type;
+  uint8_t player;
+  uint8_t index;
+};
+
+// Takes the oldest event queued. Returns false if no event is queued. Events
+// are dropped while the queue is full.
+bool JVSIO_Host_popInputEvent(struct JVSIO_InputEvent* event);
+#endif
+
+#if defined(JVSIO_HOST_CACHE)
+// Identification results of a device. If the device at the same address
+// reports the same IoId on the next enumeration, remaining identification
+// requests are skipped and cached results are notified instead.
+// `function_check_len` is 0 for an empty entry.
+struct JVSIO_DeviceCache {
+  uint8_t io_id_len;
+  uint8_t io_id[JVSIO_HOST_CACHE_IO_ID_SIZE];
+  uint8_t command_rev;
+  uint8_t jv_rev;
+  uint8_t protocol_ver;
+  uint8_t function_check_len;
+  uint8_t function_check[JVSIO_HOST_CACHE_FUNCTION_CHECK_SIZE];
+};
+
+// Restores an entry that was saved via JVSIO_Client_deviceCacheUpdated(),
+// e.g. from a non-volatile storage on boot. JVSIO_Host_init() clears all
+// entries, and this should be called after that.
+void JVSIO_Host_setDeviceCache(uint8_t address,
+                               const struct JVSIO_DeviceCache* cache);
+#endif
+
 #endif  // !defined(__JVSIO_HOST_H__)
\ No newline at end of file
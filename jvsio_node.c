@@ -9,9 +9,37 @@
 #include "jvsio_client.h"
 #include "jvsio_common_impl.h"
 
+#if defined(JVSIO_SHARED_BUFFER) && JVSIO_NODE_SPECULATIVE
+#error "Speculative mode is not available with JVSIO_SHARED_BUFFER"
+#endif
+#if defined(JVSIO_NODE_BATCH) && JVSIO_NODE_SPECULATIVE
+#error "Speculative mode is not available with JVSIO_NODE_BATCH"
+#endif
+
+// Minimum interval between packets in usec for each JVSIO_CommSupMode. The
+// spec requires 100usec for 115200bps, and the same bit times are used for
+// JVS Dash modes.
+static const uint8_t packet_interval[] = {100, 12, 4};
+
 static uint8_t new_address;
 static bool no_status;
-static enum JVSIO_CommSupMode comm_mode;
+#if defined(JVSIO_NODE_ASYNC_TX)
+static JVSIO_DATA bool tx_sending;
+// Next byte in `tx_data`, or the checksum at the end.
+static JVSIO_DATA uint16_t tx_ptr;
+// Byte to send before `tx_ptr`, or 0 if none.
+static JVSIO_DATA uint8_t tx_next;
+static JVSIO_DATA uint8_t tx_sum;
+#endif
+#if defined(JVSIO_NODE_BATCH)
+static JVSIO_XDATA struct JVSIO_Command batch[JVSIO_NODE_BATCH_SIZE];
+static uint8_t batch_size;
+#endif
+#if !defined(JVSIO_NODE_SPECULATIVE) || JVSIO_NODE_SPECULATIVE
+// Set when the client doesn't know a command in the packet in process. The
+// error status is sent after the rest of the packet is verified.
+static bool unknown_pending;
+#endif
 
 static void senseNotReady(void) {
   JVSIO_Client_setSense(false);
@@ -23,6 +51,30 @@ static void senseReady(void) {
   JVSIO_Client_setLed(true);
 }
 
+static void waitInterval(void) {
+  uint8_t interval = packet_interval[getCommMode()];
+#if defined(JVSIO_MICROSECOND_TICK)
+  // Command handling may already take the time.
+  uint32_t elapsed = JVSIO_Client_getMicroseconds() - rx_tick;
+  if (elapsed >= interval) {
+    return;
+  }
+  interval -= elapsed;
+#endif
+  JVSIO_Client_delayMicroseconds(interval);
+}
+
+#if defined(JVSIO_NODE_ASYNC_TX)
+// Hands the response in `tx_data` over to JVSIO_Node_pullByte().
+static void startSending(void) {
+  tx_sending = true;
+  tx_ptr = 0;
+  tx_next = kSync;
+  tx_sum = 0;
+  JVSIO_Client_startSending();
+}
+#endif
+
 static void sendStatus(void) {
   // Should not reply if the rx_receiving is reset, e.g. for broadcast commands.
   if (no_status) {
@@ -35,11 +87,9 @@ static void sendStatus(void) {
   // Direction should be changed within 100usec from sending/receiving a packet.
   JVSIO_Client_willSend();
 
-  if (comm_mode == k115200) {
-    // Spec requires 100usec interval at minimum between each packet.
-    // But response should be sent within 1msec from the last byte received.
-    JVSIO_Client_delayMicroseconds(100);
-  }
+  // Spec requires 100usec interval at minimum between each packet.
+  // But response should be sent within 1msec from the last byte received.
+  waitInterval();
 
   // Address is just assigned.
   // This timing to negate the sense signal is subtle. The spec expects this
@@ -50,12 +100,12 @@ static void sendStatus(void) {
   // However, as described below, sending response packet may take over 1msec.
   // Thus, this is the last place to negate the signal in a simle way.
   if (kBroadcastAddress != new_address) {
-    for (uint8_t i = 0; i < nodes; ++i) {
+    for (uint8_t i = 0; i < getNodes(); ++i) {
       if (address[i] != kBroadcastAddress) {
         continue;
       }
-      address[i] = new_address;
-      if (i == (nodes - 1)) {
+      assignAddress(i, new_address);
+      if (i == (getNodes() - 1)) {
         senseReady();
       }
       break;
@@ -66,11 +116,15 @@ static void sendStatus(void) {
   // We can send about 14 bytes per 1msec at maximum. So, it will take over 18
   // msec to send the largest packet. Actual packet will have interval time
   // between each byte. In total, it may take more time.
+#if defined(JVSIO_NODE_ASYNC_TX)
+  startSending();
+#else
   sendPacket();
+#endif
 }
 
 static void sendOkStatus(void) {
-  if (tx_report_size > 253) {
+  if (tx_report_size > kReportSizeMax) {
     pushOverflowStatus();
   } else {
     tx_data[0] = kHostAddress;
@@ -88,29 +142,102 @@ static void sendSumErrorStatus(void) {
 }
 
 static uint8_t getReceivingNode(void) {
-  uint8_t node = kBroadcastAddress;
-  for (uint8_t i = 0; i < nodes; ++i) {
-    if (address[i] == rx_data[0]) {
-      node = i;
-    }
+#if defined(JVSIO_NODE_MAP)
+  return node_map[rx_data[0]];
+#else
+  return (rx_data[0] == address[0]) ? 0 : kBroadcastAddress;
+#endif
+}
+
+#if defined(JVSIO_NODE_BATCH)
+// Returns true for commands that the library handles by itself.
+static bool isLibraryCommand(uint8_t command) {
+  switch (command) {
+    case kCmdReset:
+    case kCmdAddressSet:
+    case kCmdCommandRev:
+    case kCmdJvRev:
+    case kCmdProtocolVer:
+    case kCmdMainId:
+    case kCmdRetry:
+    case kCmdCommSup:
+    case kCmdCommChg:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Passes batched commands to the client, and appends their reports. Returns
+// false if the client doesn't know one of them.
+static bool flushCommands(uint8_t node) {
+  if (!batch_size) {
+    return true;
+  }
+  // Once reports overflow, no more room is given.
+  uint8_t used =
+      (tx_report_size < kReportSizeMax) ? tx_report_size : kReportSizeMax;
+  uint8_t* report = &tx_data[3 + used];
+  uint8_t size = kReportSizeMax - used;
+#if defined(JVSIO_SHARED_BUFFER)
+  // Should not overwrite batched commands.
+  uint8_t room = (batch[0].data > report) ? (batch[0].data - report) : 0;
+  if (room < size) {
+    size = room;
   }
-  return node;
+#endif
+  uint8_t len = 0;
+  bool known = JVSIO_Client_receiveCommands(node, batch, batch_size, report,
+                                            size, &len);
+  batch_size = 0;
+  if (len > size) {
+    tx_report_size = kReportSizeMax + 1;
+  } else if (tx_report_size <= kReportSizeMax) {
+    tx_report_size += len;
+  }
+  return known;
 }
 
+static bool batchCommand(uint8_t node, uint8_t* command, uint8_t len) {
+  if (batch_size == JVSIO_NODE_BATCH_SIZE && !flushCommands(node)) {
+    return false;
+  }
+  struct JVSIO_Command* entry = &batch[batch_size++];
+  entry->data = command;
+  entry->len = len;
+  entry->opcode = command[0];
+  return true;
+}
+#endif
+
 static bool receiveCommand(uint8_t node,
                            uint8_t* command,
                            uint8_t len,
                            bool commit) {
+#if defined(JVSIO_NODE_BATCH)
+  // Commands are always verified in batches.
+  (void)commit;
+  if (!isLibraryCommand(command[0])) {
+    return batchCommand(node, command, len);
+  }
+  // Reports for batched commands precede ones for this command.
+  if (!flushCommands(node)) {
+    return false;
+  }
+#endif
   switch (command[0]) {
     case kCmdReset:
       senseNotReady();
-      for (uint8_t i = 0; i < nodes; ++i) {
-        address[i] = kBroadcastAddress;
-      }
+      resetAddresses();
       rx_receiving = false;
       no_status = true;
       JVSIO_Client_dump("reset", NULL, 0);
+#if defined(JVSIO_NODE_BATCH)
+      batchCommand(node, command, len);
+      flushCommands(node);
+#else
       JVSIO_Client_receiveCommand(node, command, len, commit);
+#endif
       break;
     case kCmdAddressSet:
       if (downstream_ready) {
@@ -132,6 +259,9 @@ static bool receiveCommand(uint8_t node,
       break;
     case kCmdProtocolVer:
       JVSIO_Node_pushReport(kReportOk);
+#if defined(JVSIO_COMM_115200_ONLY)
+      JVSIO_Node_pushReport(0x10);
+#else
       if ((JVSIO_Client_setCommSupMode(k1M, true) ||
            JVSIO_Client_setCommSupMode(k3M, true))) {
         // Activate the JVS Dash high speed modes if underlying
@@ -140,6 +270,7 @@ static bool receiveCommand(uint8_t node,
       } else {
         JVSIO_Node_pushReport(0x10);
       }
+#endif
       break;
     case kCmdMainId:
       // We may hold the Id to provide it for the client code, but let's
@@ -152,100 +283,253 @@ static bool receiveCommand(uint8_t node,
       break;
     case kCmdCommSup:
       JVSIO_Node_pushReport(kReportOk);
+#if defined(JVSIO_COMM_115200_ONLY)
+      JVSIO_Node_pushReport(1);
+#else
       JVSIO_Node_pushReport(1 |
                             (JVSIO_Client_setCommSupMode(k1M, true) ? 2 : 0) |
                             (JVSIO_Client_setCommSupMode(k3M, true) ? 4 : 0));
+#endif
       break;
     case kCmdCommChg:
+#if !defined(JVSIO_COMM_115200_ONLY)
       if (JVSIO_Client_setCommSupMode(rx_data[rx_read_ptr + 1], false)) {
         comm_mode = rx_data[rx_read_ptr + 1];
       }
+#endif
       break;
+#if !defined(JVSIO_NODE_BATCH)
     default:
       return JVSIO_Client_receiveCommand(node, command, len, commit);
+#endif
   }
   return true;
 }
 
+#if defined(JVSIO_SHARED_BUFFER)
+// Moves commands and the checksum in the verified packet to the end of the
+// buffer so that reports can grow in place over consumed commands. Returns the
+// new position of the checksum.
+static uint8_t relocateCommands(void) {
+  uint8_t size = rx_size - 2;
+  uint8_t end = JVSIO_RX_BUFFER_SIZE - 1;
+  uint8_t start = end - size + 1;
+  memmove(&rx_data[start], &rx_data[2], size);
+  rx_read_ptr = start;
+  return end;
+}
+#endif
+
 void JVSIO_Node_pushReport(uint8_t report) {
-  if (tx_report_size < 253) {
+  // Once reports overflow, `tx_report_size` stays at `kReportSizeMax + 1`.
+  if (tx_report_size > kReportSizeMax) {
+    return;
+  }
+#if defined(JVSIO_SHARED_BUFFER)
+  // Should not overwrite the command in process.
+  if ((3 + tx_report_size) >= rx_read_ptr) {
+    tx_report_size = kReportSizeMax + 1;
+    return;
+  }
+#endif
+  if (tx_report_size < kReportSizeMax) {
     tx_data[3 + tx_report_size] = report;
-    tx_report_size++;
   }
+  tx_report_size++;
 }
 
+#if defined(JVSIO_NODE_ASYNC_TX)
+bool JVSIO_Node_pullByte(uint8_t* data) {
+  if (!tx_sending) {
+    return false;
+  }
+  if (tx_next) {
+    // SYNC, or the second byte of an escaped pair.
+    *data = tx_next;
+    tx_next = 0;
+    return true;
+  }
+  uint16_t end = tx_data[1] + 1u;
+  if (tx_ptr > end) {
+    tx_sending = false;
+    JVSIO_Client_willReceive();
+    return false;
+  }
+  uint8_t byte = tx_sum;
+  if (tx_ptr != end) {
+    byte = tx_data[tx_ptr];
+    tx_sum += byte;
+  }
+  tx_ptr++;
+  if (byte == kMarker || byte == kSync) {
+    tx_next = byte - 1;
+    byte = kMarker;
+  }
+  *data = byte;
+  return true;
+}
+#endif
+
 bool JVSIO_Node_isBusy(void) {
   return rx_receiving;
 }
 
-void JVSIO_Node_run(bool speculative) {
-  if (speculative) {
-    for (;;) {
-      receive(true);
-      if (!rx_available) {
-        return;
-      }
-      rx_available = false;
-      uint8_t node = getReceivingNode();
+enum JVSIO_NodeState JVSIO_Node_getState(void) {
+#if defined(JVSIO_NODE_ASYNC_TX)
+  if (tx_sending) {
+    return kNodeTransmitting;
+  }
+#endif
+  if (rx_available) {
+    return kNodeResponding;
+  }
+  return rx_receiving ? kNodeReceiving : kNodeIdle;
+}
+
+bool JVSIO_Node_onByte(uint8_t data, bool speculative) {
+#if defined(JVSIO_NODE_SPECULATIVE)
+  speculative = JVSIO_NODE_SPECULATIVE;
+#endif
+#if defined(JVSIO_NODE_ASYNC_TX)
+  if (tx_sending) {
+    return false;
+  }
+#endif
+  receiveByte(data);
+#if !defined(JVSIO_NODE_SPECULATIVE) || JVSIO_NODE_SPECULATIVE
+  if (unknown_pending) {
+    // Only the checksum matters for the rest of the packet.
+    speculative = false;
+  }
+#endif
+  checkPacket(speculative);
+  return rx_available;
+}
+
+#if !defined(JVSIO_NODE_SPECULATIVE) || JVSIO_NODE_SPECULATIVE
+static void runSpeculative(void) {
+  for (;;) {
+    receive(!unknown_pending);
+    if (!rx_available) {
+      return;
+    }
+    rx_available = false;
+    if (unknown_pending) {
+      // The packet that contains the unknown command is verified.
+      unknown_pending = false;
       if (rx_error) {
-        JVSIO_Client_receiveCommand(node, NULL, 0, true);
-        rx_receiving = false;
         sendSumErrorStatus();
         return;
       }
-      if (rx_receiving) {
-        uint8_t cmd = rx_data[rx_read_ptr];
-        if (cmd == kCmdReset || cmd == kCmdAddressSet || cmd == kCmdCommChg) {
-          // These commands above should not be handled without verification.
-          return;
-        }
-      }
-      uint8_t len;
-      bool known =
-          getCommandSize(&rx_data[rx_read_ptr], rx_size - rx_read_ptr, &len);
-      if (!known ||
-          !receiveCommand(node, &rx_data[rx_read_ptr], len, !rx_receiving)) {
-        while (!rx_available) {
-          receive(false);
-        }
-        if (rx_error) {
-          sendSumErrorStatus();
-          return;
-        }
-        pushUnknownCommandStatus();
-        sendStatus();
-        return;
-      }
-      rx_read_ptr += len;
-      if (!rx_receiving) {
-        sendOkStatus();
-      }
-    }
-  } else {
-    receive(false);
-    if (!rx_available) {
+      pushUnknownCommandStatus();
+      sendStatus();
       return;
     }
-    rx_available = false;
+    uint8_t node = getReceivingNode();
     if (rx_error) {
+      JVSIO_Client_receiveCommand(node, NULL, 0, true);
+      rx_receiving = false;
       sendSumErrorStatus();
       return;
     }
-    uint8_t node = getReceivingNode();
-    for (uint8_t len; rx_read_ptr < (rx_size - 1); rx_read_ptr += len) {
-      if (!getCommandSize(&rx_data[rx_read_ptr], rx_size - rx_read_ptr, &len) ||
-          !receiveCommand(node, &rx_data[rx_read_ptr], len, true)) {
-        pushUnknownCommandStatus();
-        sendStatus();
+    if (rx_receiving) {
+      uint8_t cmd = rx_data[rx_read_ptr];
+      if (cmd == kCmdReset || cmd == kCmdAddressSet || cmd == kCmdCommChg) {
+        // These commands above should not be handled without verification.
         return;
       }
     }
-    sendOkStatus();
+    uint8_t len;
+    bool known =
+        getCommandSize(&rx_data[rx_read_ptr], rx_size - rx_read_ptr, &len);
+    if (!known ||
+        !receiveCommand(node, &rx_data[rx_read_ptr], len, !rx_receiving)) {
+      if (rx_receiving) {
+        // Don't wait for the rest of the packet here, as this may run in the
+        // interrupt handler that receives it. Later runs reply to it.
+        unknown_pending = true;
+        continue;
+      }
+      pushUnknownCommandStatus();
+      sendStatus();
+      return;
+    }
+    rx_read_ptr += len;
+    if (!rx_receiving) {
+      sendOkStatus();
+    }
+  }
+}
+#endif
+
+#if !defined(JVSIO_NODE_SPECULATIVE) || !JVSIO_NODE_SPECULATIVE
+static void runVerified(void) {
+  receive(false);
+  if (!rx_available) {
+    return;
+  }
+  rx_available = false;
+  if (rx_error) {
+    sendSumErrorStatus();
+    return;
+  }
+  uint8_t node = getReceivingNode();
+  uint8_t end = rx_size - 1;
+#if defined(JVSIO_SHARED_BUFFER)
+  end = relocateCommands();
+#endif
+  for (uint8_t len; rx_read_ptr < end; rx_read_ptr += len) {
+    if (!getCommandSize(&rx_data[rx_read_ptr], end - rx_read_ptr + 1, &len) ||
+        !receiveCommand(node, &rx_data[rx_read_ptr], len, true)) {
+#if defined(JVSIO_NODE_BATCH)
+      flushCommands(node);
+#endif
+      pushUnknownCommandStatus();
+      sendStatus();
+      return;
+    }
+  }
+#if defined(JVSIO_NODE_BATCH)
+  if (!flushCommands(node)) {
+    pushUnknownCommandStatus();
+    sendStatus();
+    return;
   }
+#endif
+  sendOkStatus();
+}
+#endif
+
+void JVSIO_Node_run(bool speculative) {
+#if defined(JVSIO_NODE_ASYNC_TX)
+  if (tx_sending) {
+    return;
+  }
+#endif
+#if !defined(JVSIO_NODE_SPECULATIVE)
+  if (speculative) {
+    runSpeculative();
+  } else {
+    runVerified();
+  }
+#elif JVSIO_NODE_SPECULATIVE
+  (void)speculative;
+  runSpeculative();
+#else
+  (void)speculative;
+  runVerified();
+#endif
 }
 
 void JVSIO_Node_init(uint8_t given_nodes) {
+#if defined(JVSIO_NODE_MAP)
   nodes = given_nodes ? given_nodes : 1;
+  if (nodes > JVSIO_NODE_MAX) {
+    nodes = JVSIO_NODE_MAX;
+  }
+#else
+  (void)given_nodes;
+#endif
   rx_size = 0;
   rx_read_ptr = 0;
   rx_receiving = false;
@@ -256,9 +540,19 @@ void JVSIO_Node_init(uint8_t given_nodes) {
   no_status = false;
   tx_report_size = 0;
   downstream_ready = false;
+#if !defined(JVSIO_COMM_115200_ONLY)
   comm_mode = k115200;
-  for (uint8_t i = 0; i < nodes; ++i)
-    address[i] = kBroadcastAddress;
+#endif
+#if defined(JVSIO_NODE_ASYNC_TX)
+  tx_sending = false;
+#endif
+#if defined(JVSIO_NODE_BATCH)
+  batch_size = 0;
+#endif
+#if !defined(JVSIO_NODE_SPECULATIVE) || JVSIO_NODE_SPECULATIVE
+  unknown_pending = false;
+#endif
+  resetAddresses();
 
   JVSIO_Client_willReceive();
 }
\ No newline at end of file
@@ -8,9 +8,42 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "jvsio_config.h"
+
 void JVSIO_Node_init(uint8_t nodes);
 void JVSIO_Node_run(bool speculative);
 void JVSIO_Node_pushReport(uint8_t report);
 bool JVSIO_Node_isBusy(void);
 
+enum JVSIO_NodeState {
+  kNodeIdle,          // Waits for the next packet.
+  kNodeReceiving,     // Receives a packet in the middle.
+  kNodeResponding,    // Has commands for JVSIO_Node_run() to handle.
+  kNodeTransmitting,  // Sends a response via JVSIO_Node_pullByte().
+};
+
+// Returns the protocol state between JVSIO_Node_run() calls. Nothing happens
+// while the state is kNodeIdle until the next byte arrives, and the client may
+// put the CPU into idle or sleep to wake up on the UART activity.
+enum JVSIO_NodeState JVSIO_Node_getState(void);
+
+// Decodes a byte received, e.g. in a UART RX interrupt handler, instead of
+// letting JVSIO_Node_run() poll JVSIO_Client_receive(). Returns true if a
+// command is ready to process, and JVSIO_Node_run() should be called with the
+// same `speculative` to handle it. JVSIO_Node_run() can be called in the
+// interrupt handler so that responses don't wait for the main loop, but should
+// not run concurrently with this function. JVSIO_Node_run() never waits for
+// bytes. If a packet contains a command that the client doesn't know in the
+// speculative mode, the error status is sent after the whole packet arrives.
+bool JVSIO_Node_onByte(uint8_t data, bool speculative);
+
+#if defined(JVSIO_NODE_ASYNC_TX)
+// Takes the next byte of the response to send in `data`, e.g. in a UART TX
+// interrupt handler. Returns false after the last byte, and
+// JVSIO_Client_willReceive() is called at that time. Packets are not received
+// while the response is being sent, and bytes passed to JVSIO_Node_onByte() in
+// the meantime are ignored.
+bool JVSIO_Node_pullByte(uint8_t* data);
+#endif
+
 #endif  // !defined(__JVSIO_NODE_H__)
\ No newline at end of file
@@ -0,0 +1,104 @@
+// Copyright 2023 Takashi Toyoshima <toyoshim@gmail.com>.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "jvsio.hpp"
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace {
+
+constexpr auto kPoll =
+    jvsio::BuildFrame(1, jvsio::Concat(jvsio::SwInput(2, 2),
+                                       jvsio::CoinInput(2)));
+
+// Frames should be built at compile time.
+static_assert(kPoll.size == 9);
+static_assert(kPoll.bytes[0] == kSync);
+static_assert(kPoll.bytes[8] == 0x4e);
+
+// Special bytes, and the checksum that follows them, should be escaped.
+constexpr auto kEscaped = jvsio::BuildFrame(
+    kBroadcastAddress,
+    jvsio::DriverOutput(std::array<uint8_t, 3>{kMarker, kSync, 0xf6}));
+static_assert(kEscaped.size == 12);
+static_assert(kEscaped.bytes[5] == kMarker);
+static_assert(kEscaped.bytes[6] == kMarker - 1);
+static_assert(kEscaped.bytes[7] == kMarker);
+static_assert(kEscaped.bytes[8] == kSync - 1);
+static_assert(kEscaped.bytes[10] == kMarker);
+static_assert(kEscaped.bytes[11] == kSync - 1);
+
+std::vector<uint8_t> ToVector(const uint8_t* data, size_t size) {
+  return std::vector<uint8_t>(data, data + size);
+}
+
+}  // namespace
+
+TEST(FrameTest, Commands) {
+  EXPECT_EQ(std::vector<uint8_t>({kCmdReset, 0xd9}),
+            ToVector(jvsio::Reset().data(), jvsio::Reset().size()));
+
+  constexpr auto kMainId = jvsio::MainId("AB");
+  EXPECT_EQ(std::vector<uint8_t>({kCmdMainId, 'A', 'B', 0}),
+            ToVector(kMainId.data(), kMainId.size()));
+
+  constexpr auto kCoinSub = jvsio::CoinSub(2, 0x0102);
+  EXPECT_EQ(std::vector<uint8_t>({kCmdCoinSub, 2, 0x01, 0x02}),
+            ToVector(kCoinSub.data(), kCoinSub.size()));
+
+  constexpr auto kAnalog =
+      jvsio::AnalogOutput(std::array<uint16_t, 2>{0x1234, 0xabcd});
+  EXPECT_EQ(
+      std::vector<uint8_t>({kCmdAnalogOutput, 2, 0x12, 0x34, 0xab, 0xcd}),
+      ToVector(kAnalog.data(), kAnalog.size()));
+
+  constexpr auto kCommChg = jvsio::CommChg(k3M);
+  EXPECT_EQ(std::vector<uint8_t>({kCmdCommChg, 2}),
+            ToVector(kCommChg.data(), kCommChg.size()));
+}
+
+TEST(FrameTest, Frame) {
+  EXPECT_EQ(std::vector<uint8_t>({kSync, 0x01, 0x06, kCmdSwInput, 0x02, 0x02,
+                                  kCmdCoinInput, 0x02, 0x4e}),
+            ToVector(kPoll.data(), kPoll.size));
+
+  EXPECT_EQ(std::vector<uint8_t>({kSync, 0xff, 0x06, kCmdDriverOutput, 0x03,
+                                  kMarker, kMarker - 1, kMarker, kSync - 1,
+                                  0xf6, kMarker, kSync - 1}),
+            ToVector(kEscaped.data(), kEscaped.size));
+}
+
+TEST(FrameTest, Views) {
+  static constexpr uint8_t kSwitches[] = {0x80, 0x01, 0x40, 0x20, 0x00};
+  constexpr jvsio::SwitchView switches(kSwitches, 2, 2);
+  EXPECT_TRUE(switches.IsTestPressed());
+  EXPECT_TRUE(switches.IsPressed(1, 7));
+  EXPECT_TRUE(switches.IsPressed(1, 9));
+  EXPECT_FALSE(switches.IsPressed(1, 8));
+  EXPECT_TRUE(switches.IsPressed(2, 2));
+  EXPECT_EQ(0x20, switches.GetByte(2, 0));
+
+  static constexpr uint8_t kCoins[] = {0x00, 0x03, 0x81, 0x02};
+  constexpr jvsio::CoinView coins(kCoins, 2);
+  EXPECT_EQ(0, coins.GetCondition(1));
+  EXPECT_EQ(3, coins.GetCount(1));
+  EXPECT_EQ(2, coins.GetCondition(2));
+  EXPECT_EQ(0x0102, coins.GetCount(2));
+
+  static constexpr uint8_t kAnalog[] = {0x12, 0x34, 0xff, 0xc0};
+  constexpr jvsio::AnalogView analog(kAnalog, 2);
+  EXPECT_EQ(0x1234, analog.GetValue(0));
+  EXPECT_EQ(0xffc0, analog.GetValue(1));
+}
+
+TEST(FrameTest, SyncView) {
+  // Status, SwInput, and CoinInput reports.
+  const uint8_t kResponse[] = {0x01, 0x01, 0x00, 0x40, 0x01, 0x00, 0x05};
+  JVSIO_SyncReport report = {kResponse, sizeof(kResponse), 1, 1, 1, 2, 5};
+  jvsio::SyncView view(report);
+  EXPECT_TRUE(view.GetSwitches().IsPressed(1, 1));
+  EXPECT_EQ(5, view.GetCoins().GetCount(1));
+}
@@ -3,49 +3,999 @@
 // in the LICENSE file.
 
 extern "C" {
+#include "jvsio_client.h"
+#include "jvsio_common.h"
 #include "jvsio_host.h"
 }  // extern "C"
 
+#include <cstring>
+#include <queue>
+#include <vector>
+
 #include "gtest/gtest.h"
+#include "jvsio.hpp"
 
 class HostTest : public ::testing::Test {
+ public:
+  static int IsDataAvailable() {
+    if (instance->incoming_data_.empty())
+      return 0;
+    return 1;
+  }
+  static uint8_t ReadData() {
+    auto c = instance->incoming_data_.front();
+    instance->incoming_data_.pop();
+    return c;
+  }
+  static void WriteData(uint8_t data) { instance->Write(data); }
+  static bool IsSenseReady() {
+    for (const auto& device : instance->devices_) {
+      if (!device.address)
+        return false;
+    }
+    return true;
+  }
+  static bool IsSenseConnected() { return instance->connected_; }
+  static uint32_t GetTick() { return instance->tick_; }
+  static uint32_t GetMicroseconds() {
+    return instance->tick_ * 1000 + instance->microseconds_;
+  }
+  static void IoIdReceived(uint8_t address, uint8_t* data, uint8_t len) {
+    instance->io_ids_.push_back(std::vector<uint8_t>(data, data + len));
+  }
+  static void FunctionCheckReceived(uint8_t address,
+                                    uint8_t* data,
+                                    uint8_t len) {
+    instance->function_checks_.push_back(
+        std::vector<uint8_t>(data, data + len));
+  }
+  static void Synced(uint8_t players,
+                     uint8_t coin_state,
+                     uint8_t* sw_state0,
+                     uint8_t* sw_state1) {
+    instance->synced_++;
+    instance->synced_players_ = players;
+    instance->synced_sw_state0_.assign(sw_state0, sw_state0 + 4);
+  }
+  static void SyncReceived(uint8_t address,
+                           const struct JVSIO_SyncReport* report) {
+    instance->sync_reports_.push_back(*report);
+    instance->sync_report_data_.push_back(
+        std::vector<uint8_t>(report->data, report->data + report->len));
+  }
+  static void TransactionCompleted(uint8_t id, uint8_t* status, uint8_t len) {
+    Transaction transaction;
+    transaction.id = id;
+    transaction.tick = instance->tick_;
+    transaction.completed = status != nullptr;
+    if (status)
+      transaction.status.assign(status, status + len);
+    instance->transactions_.push_back(transaction);
+  }
+  static void DeviceCacheUpdated(uint8_t address,
+                                 const struct JVSIO_DeviceCache* cache) {
+    instance->cache_updates_++;
+  }
+
+ protected:
+  // A fake I/O device that behaves as a minimum JVS node on the bus.
+  struct Device {
+    uint8_t address = 0;
+    bool alive = true;
+    int drops = 0;                 // Responses to drop.
+    bool single_command = false;   // Rejects multiple commands in a packet.
+    bool silent_on_batch = false;  // Ignores multiple commands in a packet.
+    std::vector<uint8_t> io_id = {'T', 'E', 'S', 'T', 0};
+    std::vector<uint8_t> function_check = {0x01, 0x02, 0x10, 0x00,
+                                           0x02, 0x02, 0x00, 0x00,
+                                           0x12, 0x10, 0x00, 0x00,
+                                           0x13, 0x02, 0x00, 0x00};
+    uint8_t sw[1 + 2 * 2] = {};
+    uint16_t coins[2] = {};
+    std::vector<uint8_t> gpo;
+    std::vector<uint8_t> analog;
+  };
+
+  struct Transaction {
+    uint8_t id;
+    uint32_t tick;
+    bool completed;
+    std::vector<uint8_t> status;
+  };
+
+  void AddDevice() { devices_.push_back(Device()); }
+  Device& GetDevice(size_t index) { return devices_[index]; }
+
+  // Lets the device stop responding, and lose the address that the sense line
+  // shows, as if it is turned off.
+  void TurnOff(size_t index) {
+    devices_[index].alive = false;
+    devices_[index].address = 0;
+  }
+
+  void SetConnected(bool connected) { connected_ = connected; }
+  void AdvanceTick(uint32_t tick) { tick_ += tick; }
+  void AdvanceMicroseconds(uint32_t usec) { microseconds_ += usec; }
+
+  // Runs the host until it gets ready, and returns true on success.
+  bool RunUntilReady(size_t max_steps = 10000) {
+    for (size_t i = 0; i < max_steps; ++i) {
+      if (JVSIO_Host_run())
+        return true;
+      tick_++;
+    }
+    return false;
+  }
+
+  // Requests a sync, and runs the host until the sync finishes.
+  bool Sync(size_t max_steps = 10000) {
+    int synced = synced_;
+    JVSIO_Host_sync();
+    for (size_t i = 0; i < max_steps; ++i) {
+      JVSIO_Host_run();
+      if (synced != synced_)
+        return true;
+      tick_++;
+    }
+    return false;
+  }
+
+  // Runs the host only when JVSIO_Host_getWait() allows, jumping the tick to
+  // each deadline, and returns the number of runs until it waits for requests,
+  // or 0.
+  size_t RunWithWaitsUntilReady(size_t max_runs = 100) {
+    for (size_t runs = 1; runs <= max_runs; ++runs) {
+      if (JVSIO_Host_run())
+        return runs;
+      uint32_t deadline = tick_;
+      switch (JVSIO_Host_getWait(&deadline)) {
+        case kHostWaitNone:
+          continue;
+        case kHostWaitData:
+          if (IsDataAvailable())
+            continue;
+          break;
+        case kHostWaitSense:
+          if (IsSenseReady())
+            continue;
+          break;
+        case kHostWaitTimer:
+          break;
+        case kHostWaitRequest:
+          return runs;
+        default:
+          return 0;
+      }
+      EXPECT_LT(tick_, deadline);
+      tick_ = deadline;
+    }
+    return 0;
+  }
+
+  // Returns the number of packets that the host sent, and forgets them.
+  size_t TakeRequestCount() {
+    size_t count = requests_.size();
+    requests_.clear();
+    request_ticks_.clear();
+    return count;
+  }
+
+  const std::vector<std::vector<uint8_t>>& GetRequests() { return requests_; }
+  const std::vector<uint32_t>& GetRequestTicks() { return request_ticks_; }
+  const std::vector<std::vector<uint8_t>>& GetIoIds() { return io_ids_; }
+  const std::vector<std::vector<uint8_t>>& GetFunctionChecks() {
+    return function_checks_;
+  }
+  int GetCacheUpdates() { return cache_updates_; }
+  const std::vector<Transaction>& GetTransactions() { return transactions_; }
+  const std::vector<JVSIO_SyncReport>& GetSyncReports() {
+    return sync_reports_;
+  }
+  const std::vector<std::vector<uint8_t>>& GetSyncReportData() {
+    return sync_report_data_;
+  }
+  uint8_t GetSyncedPlayers() { return synced_players_; }
+  const std::vector<uint8_t>& GetSyncedSwState0() { return synced_sw_state0_; }
+
  private:
-  void SetUp() override { JVSIO_Host_init(); }
+  void SetUp() override {
+    instance = this;
+    JVSIO_Host_init();
+  }
+
+  void Write(uint8_t data) {
+    if (data == kSync) {
+      packet_.clear();
+      marked_ = false;
+      return;
+    }
+    if (data == kMarker) {
+      marked_ = true;
+      return;
+    }
+    packet_.push_back(marked_ ? data + 1 : data);
+    marked_ = false;
+    if (packet_.size() < 2 || packet_.size() != packet_[1] + 2u)
+      return;
+    uint8_t sum = 0;
+    for (size_t i = 0; i < packet_.size() - 1; ++i)
+      sum += packet_[i];
+    EXPECT_EQ(sum, packet_.back());
+    requests_.push_back(packet_);
+    request_ticks_.push_back(tick_);
+    Respond(packet_);
+  }
+
+  void Respond(const std::vector<uint8_t>& packet) {
+    std::vector<uint8_t> commands(packet.begin() + 2, packet.end() - 1);
+    if (packet[0] == kBroadcastAddress) {
+      if (commands[0] == kCmdReset) {
+        for (auto& device : devices_)
+          device.address = 0;
+      } else if (commands[0] == kCmdAddressSet) {
+        for (auto& device : devices_) {
+          if (device.address)
+            continue;
+          device.address = commands[1];
+          if (device.alive)
+            SendResponse(0x01, {kReportOk});
+          break;
+        }
+      }
+      return;
+    }
+    for (auto& device : devices_) {
+      if (device.address != packet[0] || !device.alive)
+        continue;
+      if (device.drops) {
+        device.drops--;
+        continue;
+      }
+      HandleCommands(device, commands);
+    }
+  }
+
+  void HandleCommands(Device& device, const std::vector<uint8_t>& commands) {
+    if (device.silent_on_batch && commands.size() > 1 &&
+        commands[0] == kCmdIoId) {
+      return;
+    }
+    if (device.single_command && commands.size() > 1 &&
+        commands[0] == kCmdIoId) {
+      SendResponse(0x02, {});
+      return;
+    }
+    std::vector<uint8_t> reports;
+    for (size_t i = 0; i < commands.size();) {
+      reports.push_back(kReportOk);
+      switch (commands[i]) {
+        case kCmdIoId:
+          reports.insert(reports.end(), device.io_id.begin(),
+                         device.io_id.end());
+          i += 1;
+          break;
+        case kCmdCommandRev:
+          reports.push_back(0x13);
+          i += 1;
+          break;
+        case kCmdJvRev:
+          reports.push_back(0x30);
+          i += 1;
+          break;
+        case kCmdProtocolVer:
+          reports.push_back(0x10);
+          i += 1;
+          break;
+        case kCmdFunctionCheck:
+          reports.insert(reports.end(), device.function_check.begin(),
+                         device.function_check.end());
+          reports.push_back(0x00);
+          i += 1;
+          break;
+        case kCmdSwInput:
+          reports.push_back(device.sw[0]);
+          for (uint8_t j = 0; j < commands[i + 1] * commands[i + 2]; ++j)
+            reports.push_back(device.sw[1 + j]);
+          i += 3;
+          break;
+        case kCmdCoinInput:
+          for (uint8_t j = 0; j < commands[i + 1]; ++j) {
+            reports.push_back(device.coins[j] >> 8);
+            reports.push_back(device.coins[j]);
+          }
+          i += 2;
+          break;
+        case kCmdCoinSub:
+          device.coins[commands[i + 1] - 1] -=
+              (commands[i + 2] << 8) | commands[i + 3];
+          i += 4;
+          break;
+        case kCmdDriverOutput:
+          device.gpo.assign(commands.begin() + i + 2,
+                            commands.begin() + i + 2 + commands[i + 1]);
+          i += 2 + commands[i + 1];
+          break;
+        case kCmdAnalogOutput:
+          device.analog.assign(commands.begin() + i + 2,
+                               commands.begin() + i + 2 + commands[i + 1] * 2);
+          i += 2 + commands[i + 1] * 2;
+          break;
+        default:
+          SendResponse(0x02, {});
+          return;
+      }
+    }
+    SendResponse(0x01, reports);
+  }
+
+  void SendResponse(uint8_t status, const std::vector<uint8_t>& reports) {
+    std::vector<uint8_t> data = {kHostAddress,
+                                 static_cast<uint8_t>(reports.size() + 2),
+                                 status};
+    data.insert(data.end(), reports.begin(), reports.end());
+    uint8_t sum = 0;
+    for (uint8_t c : data)
+      sum += c;
+    data.push_back(sum);
+    incoming_data_.push(kSync);
+    for (uint8_t c : data) {
+      if (c == kSync || c == kMarker) {
+        incoming_data_.push(kMarker);
+        incoming_data_.push(c - 1);
+      } else {
+        incoming_data_.push(c);
+      }
+    }
+  }
+
+  bool connected_ = true;
+  uint32_t tick_ = 0;
+  uint32_t microseconds_ = 0;
+  std::queue<uint8_t> incoming_data_;
+  std::vector<uint8_t> packet_;
+  bool marked_ = false;
+  std::vector<std::vector<uint8_t>> requests_;
+  std::vector<uint32_t> request_ticks_;
+  std::vector<Device> devices_;
+  std::vector<std::vector<uint8_t>> io_ids_;
+  std::vector<std::vector<uint8_t>> function_checks_;
+  int synced_ = 0;
+  uint8_t synced_players_ = 0;
+  std::vector<uint8_t> synced_sw_state0_;
+  int cache_updates_ = 0;
+  std::vector<Transaction> transactions_;
+  std::vector<JVSIO_SyncReport> sync_reports_;
+  std::vector<std::vector<uint8_t>> sync_report_data_;
+
+  static HostTest* instance;
 };
 
+HostTest* HostTest::instance = nullptr;
+
 extern "C" {
 int JVSIO_Client_isDataAvailable() {
-  return 0;
+  return HostTest::IsDataAvailable();
 }
 void JVSIO_Client_willSend() {}
 void JVSIO_Client_willReceive() {}
-void JVSIO_Client_send(uint8_t data) {}
+void JVSIO_Client_send(uint8_t data) {
+  HostTest::WriteData(data);
+}
 uint8_t JVSIO_Client_receive() {
-  return 0;
+  return HostTest::ReadData();
 }
 void JVSIO_Client_dump(const char* str, uint8_t* data, uint8_t len) {}
 bool JVSIO_Client_isSenseReady() {
-  return false;
+  return HostTest::IsSenseReady();
 }
 bool JVSIO_Client_isSenseConnected() {
-  return false;
+  return HostTest::IsSenseConnected();
 }
 uint32_t JVSIO_Client_getTick() {
-  return 0;
+  return HostTest::GetTick();
+}
+uint32_t JVSIO_Client_getMicroseconds() {
+  return HostTest::GetMicroseconds();
+}
+void JVSIO_Client_ioIdReceived(uint8_t address, uint8_t* data, uint8_t len) {
+  HostTest::IoIdReceived(address, data, len);
 }
-void JVSIO_Client_ioIdReceived(uint8_t address, uint8_t* data, uint8_t len) {}
 void JVSIO_Client_commandRevReceived(uint8_t address, uint8_t rev) {}
 void JVSIO_Client_jvRevReceived(uint8_t address, uint8_t rev) {}
 void JVSIO_Client_protocolVerReceived(uint8_t address, uint8_t rev) {}
 void JVSIO_Client_functionCheckReceived(uint8_t address,
                                         uint8_t* data,
-                                        uint8_t len) {}
+                                        uint8_t len) {
+  HostTest::FunctionCheckReceived(address, data, len);
+}
 void JVSIO_Client_synced(uint8_t players,
                          uint8_t coin_state,
                          uint8_t* sw_state0,
-                         uint8_t* sw_state1) {}
+                         uint8_t* sw_state1) {
+  HostTest::Synced(players, coin_state, sw_state0, sw_state1);
+}
+void JVSIO_Client_syncReceived(uint8_t address,
+                               const struct JVSIO_SyncReport* report) {
+  HostTest::SyncReceived(address, report);
+}
+void JVSIO_Client_transactionCompleted(uint8_t id,
+                                       uint8_t* status,
+                                       uint8_t len) {
+  HostTest::TransactionCompleted(id, status, len);
+}
+void JVSIO_Client_deviceCacheUpdated(uint8_t address,
+                                     const struct JVSIO_DeviceCache* cache) {
+  HostTest::DeviceCacheUpdated(address, cache);
+}
 }  // extern "C"
 
 TEST_F(HostTest, CompileAndLink) {
   JVSIO_Host_run();
-}
\ No newline at end of file
+}
+
+TEST_F(HostTest, Enumerate) {
+  AddDevice();
+  ASSERT_TRUE(RunUntilReady());
+
+  // RESET x2, ADDRESS, IoId, CommandRev, JvRev, ProtocolVer, FunctionCheck.
+  EXPECT_EQ(8u, TakeRequestCount());
+  ASSERT_EQ(1u, GetIoIds().size());
+  EXPECT_EQ(5u, GetIoIds()[0].size());
+  ASSERT_EQ(1u, GetFunctionChecks().size());
+
+  GetDevice(0).sw[1] = 0x80;
+  ASSERT_TRUE(Sync());
+  EXPECT_EQ(2u, GetSyncedPlayers());
+  EXPECT_EQ(0x80, GetSyncedSwState0()[0]);
+}
+
+TEST_F(HostTest, EnumerateWithCache) {
+  AddDevice();
+  ASSERT_TRUE(RunUntilReady());
+  EXPECT_EQ(8u, TakeRequestCount());
+  EXPECT_EQ(1, GetCacheUpdates());
+
+  // Reconnecting the same device should skip identification requests after
+  // the IoId.
+  SetConnected(false);
+  JVSIO_Host_run();
+  SetConnected(true);
+  ASSERT_TRUE(RunUntilReady());
+  EXPECT_EQ(4u, TakeRequestCount());
+  EXPECT_EQ(2u, GetFunctionChecks().size());
+  EXPECT_EQ(GetFunctionChecks()[0], GetFunctionChecks()[1]);
+  EXPECT_EQ(1, GetCacheUpdates());
+
+  // A different device should be identified from scratch.
+  SetConnected(false);
+  JVSIO_Host_run();
+  SetConnected(true);
+  GetDevice(0).io_id = {'N', 'E', 'W', 0};
+  ASSERT_TRUE(RunUntilReady());
+  EXPECT_EQ(8u, TakeRequestCount());
+  EXPECT_EQ(2, GetCacheUpdates());
+}
+
+TEST_F(HostTest, EnumerateWithBrokenCache) {
+  AddDevice();
+  JVSIO_DeviceCache entry = {};
+  entry.io_id_len = GetDevice(0).io_id.size();
+  memcpy(entry.io_id, GetDevice(0).io_id.data(), entry.io_id_len);
+  entry.function_check_len = 255;
+  JVSIO_Host_setDeviceCache(1, &entry);
+
+  // Entries with sizes that exceed the buffers should be ignored.
+  ASSERT_TRUE(RunUntilReady());
+  EXPECT_EQ(8u, TakeRequestCount());
+  EXPECT_EQ(1u, GetFunctionChecks().size());
+}
+
+TEST_F(HostTest, EnumerateInBatch) {
+  AddDevice();
+  AddDevice();
+  JVSIO_Host_setBatchEnumeration(true);
+  ASSERT_TRUE(RunUntilReady());
+
+  // RESET x2, ADDRESS x2, and a batched identification per device.
+  EXPECT_EQ(6u, TakeRequestCount());
+  ASSERT_EQ(2u, GetIoIds().size());
+  EXPECT_EQ(GetDevice(0).io_id, GetIoIds()[0]);
+  ASSERT_EQ(2u, GetFunctionChecks().size());
+  std::vector<uint8_t> function_check = GetDevice(0).function_check;
+  function_check.push_back(0x00);
+  EXPECT_EQ(function_check, GetFunctionChecks()[0]);
+
+  ASSERT_TRUE(Sync());
+  EXPECT_EQ(4u, GetSyncedPlayers());
+}
+
+TEST_F(HostTest, EnumerateInBatchFallback) {
+  AddDevice();
+  GetDevice(0).single_command = true;
+  JVSIO_Host_setBatchEnumeration(true);
+  ASSERT_TRUE(RunUntilReady());
+
+  // RESET x2, ADDRESS, a rejected batch, and five identification requests.
+  EXPECT_EQ(9u, TakeRequestCount());
+  ASSERT_EQ(1u, GetIoIds().size());
+  ASSERT_EQ(1u, GetFunctionChecks().size());
+}
+
+TEST_F(HostTest, EnumerateInBatchSilentFallback) {
+  AddDevice();
+  GetDevice(0).silent_on_batch = true;
+  JVSIO_Host_setBatchEnumeration(true);
+  ASSERT_TRUE(RunUntilReady());
+
+  // RESET x2, ADDRESS, an ignored batch, and five identification requests.
+  EXPECT_EQ(9u, TakeRequestCount());
+  ASSERT_EQ(1u, GetIoIds().size());
+  ASSERT_EQ(1u, GetFunctionChecks().size());
+}
+
+TEST_F(HostTest, LongChain) {
+  for (int i = 0; i < JVSIO_HOST_DEVICE_MAX + 2; ++i)
+    AddDevice();
+  GetDevice(0).function_check[1] = 1;  // A single player device.
+  ASSERT_TRUE(RunUntilReady());
+  EXPECT_EQ(JVSIO_HOST_DEVICE_MAX + 2u, GetIoIds().size());
+  TakeRequestCount();
+
+  // Only devices that capabilities are tracked for should be polled, and
+  // players should be packed in order of addresses.
+  GetDevice(1).sw[1] = 0x80;
+  GetDevice(1).sw[3] = 0x40;
+  ASSERT_TRUE(Sync());
+  EXPECT_EQ(static_cast<size_t>(JVSIO_HOST_DEVICE_MAX), TakeRequestCount());
+  EXPECT_EQ(4u, GetSyncedPlayers());
+  EXPECT_EQ(0x80, GetSyncedSwState0()[1]);
+  EXPECT_EQ(0x40, GetSyncedSwState0()[2]);
+}
+
+TEST_F(HostTest, Transaction) {
+  AddDevice();
+  ASSERT_TRUE(RunUntilReady());
+  TakeRequestCount();
+
+  const uint8_t kLowCommand[] = {kCmdDriverOutput, 0x01, 0x00};
+  const uint8_t kHighCommand[] = {kCmdDriverOutput, 0x01, 0xff};
+  const uint8_t kUnknownCommand[] = {0x7f};
+  uint8_t low = JVSIO_Host_submit(1, kLowCommand, sizeof(kLowCommand), 1,
+                                  GetTick() + 100);
+  uint8_t high = JVSIO_Host_submit(1, kHighCommand, sizeof(kHighCommand), 0,
+                                   GetTick() + 100);
+  uint8_t expired = JVSIO_Host_submit(1, kLowCommand, sizeof(kLowCommand), 0,
+                                      GetTick() - 1);
+  uint8_t unknown = JVSIO_Host_submit(1, kUnknownCommand,
+                                      sizeof(kUnknownCommand), 2,
+                                      GetTick() + 100);
+  ASSERT_NE(0, low);
+  ASSERT_NE(0, high);
+  ASSERT_NE(0, expired);
+  ASSERT_NE(0, unknown);
+  EXPECT_EQ(0, JVSIO_Host_submit(1, kLowCommand, sizeof(kLowCommand), 0,
+                                 GetTick() + 100));
+
+  // A sync requested earlier should be prioritized.
+  ASSERT_TRUE(Sync());
+  EXPECT_EQ(kCmdSwInput, GetRequests()[0][2]);
+  EXPECT_TRUE(GetTransactions().empty());
+
+  ASSERT_TRUE(RunUntilReady());
+  ASSERT_EQ(4u, GetTransactions().size());
+  EXPECT_EQ(expired, GetTransactions()[0].id);
+  EXPECT_FALSE(GetTransactions()[0].completed);
+  EXPECT_EQ(high, GetTransactions()[1].id);
+  EXPECT_TRUE(GetTransactions()[1].completed);
+  EXPECT_EQ(std::vector<uint8_t>({0x01, kReportOk}),
+            GetTransactions()[1].status);
+  EXPECT_EQ(low, GetTransactions()[2].id);
+  EXPECT_TRUE(GetTransactions()[2].completed);
+  EXPECT_EQ(unknown, GetTransactions()[3].id);
+  EXPECT_TRUE(GetTransactions()[3].completed);
+  EXPECT_EQ(std::vector<uint8_t>({0x02}), GetTransactions()[3].status);
+  EXPECT_EQ(4u, TakeRequestCount());
+}
+
+TEST_F(HostTest, TransactionDefersSync) {
+  AddDevice();
+  ASSERT_TRUE(RunUntilReady());
+  TakeRequestCount();
+
+  // A sync requested while a command is in flight should follow it.
+  const uint8_t kCommand[] = {kCmdDriverOutput, 0x01, 0x00};
+  ASSERT_NE(0, JVSIO_Host_submit(1, kCommand, sizeof(kCommand), 0,
+                                 GetTick() + 100));
+  EXPECT_FALSE(JVSIO_Host_run());
+  ASSERT_TRUE(Sync());
+  ASSERT_EQ(1u, GetTransactions().size());
+  EXPECT_TRUE(GetTransactions()[0].completed);
+  ASSERT_EQ(2u, GetRequests().size());
+  EXPECT_EQ(kCmdDriverOutput, GetRequests()[0][2]);
+  EXPECT_EQ(kCmdSwInput, GetRequests()[1][2]);
+}
+
+TEST_F(HostTest, TransactionTimeoutDefersSync) {
+  AddDevice();
+  ASSERT_TRUE(RunUntilReady());
+  ASSERT_TRUE(Sync());
+  TakeRequestCount();
+
+  // An output that the device doesn't reply to should delay a sync only by the
+  // timeout for the status-only response, i.e. 5 + 1 bytes in 86.8 usec each,
+  // in addition to the 2000 usec turnaround.
+  const uint32_t kTimeout = 2000 + (5 + 1) * 868 / 10;
+  const uint8_t kCommand[] = {kCmdDriverOutput, 0x01, 0x00};
+  GetDevice(0).drops = 1;
+  ASSERT_NE(0, JVSIO_Host_submit(1, kCommand, sizeof(kCommand), 0,
+                                 GetTick() + 100));
+  EXPECT_FALSE(JVSIO_Host_run());
+  ASSERT_EQ(1u, GetRequests().size());
+  JVSIO_Host_sync();
+  uint32_t elapsed = 0;
+  for (; elapsed <= kTimeout + 1 && GetRequests().size() < 2; ++elapsed) {
+    AdvanceMicroseconds(1);
+    for (int i = 0; i < 3; ++i)
+      JVSIO_Host_run();
+  }
+  // The sync starts right after the timeout.
+  ASSERT_EQ(2u, GetRequests().size());
+  EXPECT_EQ(kCmdSwInput, GetRequests()[1][2]);
+  EXPECT_EQ(kTimeout + 1, elapsed);
+  ASSERT_EQ(1u, GetTransactions().size());
+  EXPECT_FALSE(GetTransactions()[0].completed);
+}
+
+TEST_F(HostTest, TransactionReports) {
+  AddDevice();
+  GetDevice(0).sw[0] = 0x80;
+  GetDevice(0).coins[1] = 3;
+  ASSERT_TRUE(RunUntilReady());
+
+  const uint8_t kCommand[] = {kCmdIoId, kCmdSwInput, 0x02, 0x02,
+                              kCmdCoinInput, 0x02, kCmdDriverOutput, 0x01,
+                              0x00};
+  ASSERT_NE(0, JVSIO_Host_submit(1, kCommand, sizeof(kCommand), 0,
+                                 GetTick() + 100));
+  ASSERT_TRUE(RunUntilReady());
+  ASSERT_EQ(1u, GetTransactions().size());
+  std::vector<uint8_t> status = GetTransactions()[0].status;
+
+  JVSIO_ReportReader reader;
+  uint8_t len;
+  ASSERT_TRUE(JVSIO_Host_beginReports(&reader, kCommand, sizeof(kCommand),
+                                      status.data(), status.size()));
+  EXPECT_EQ(kCmdIoId, *reader.command);
+  uint8_t* report = JVSIO_Host_nextReport(&reader, &len);
+  ASSERT_NE(nullptr, report);
+  EXPECT_EQ(std::vector<uint8_t>({kReportOk, 'T', 'E', 'S', 'T', 0}),
+            std::vector<uint8_t>(report, report + len));
+  EXPECT_EQ(kCmdSwInput, *reader.command);
+  report = JVSIO_Host_nextReport(&reader, &len);
+  ASSERT_NE(nullptr, report);
+  ASSERT_EQ(6u, len);
+  EXPECT_EQ(0x80, report[1]);
+  report = JVSIO_Host_nextReport(&reader, &len);
+  ASSERT_NE(nullptr, report);
+  EXPECT_EQ(std::vector<uint8_t>({kReportOk, 0x00, 0x00, 0x00, 0x03}),
+            std::vector<uint8_t>(report, report + len));
+  report = JVSIO_Host_nextReport(&reader, &len);
+  ASSERT_NE(nullptr, report);
+  EXPECT_EQ(1u, len);
+  EXPECT_EQ(nullptr, JVSIO_Host_nextReport(&reader, &len));
+  EXPECT_TRUE(JVSIO_Host_endReports(&reader));
+
+  // Reports that don't match with the commands should be detected.
+  ASSERT_TRUE(JVSIO_Host_beginReports(&reader, kCommand, sizeof(kCommand),
+                                      status.data(), status.size() - 1));
+  for (int i = 0; i < 3; ++i)
+    ASSERT_NE(nullptr, JVSIO_Host_nextReport(&reader, &len));
+  EXPECT_EQ(nullptr, JVSIO_Host_nextReport(&reader, &len));
+  EXPECT_FALSE(JVSIO_Host_endReports(&reader));
+}
+
+TEST_F(HostTest, TransactionFrame) {
+  AddDevice();
+  ASSERT_TRUE(RunUntilReady());
+  TakeRequestCount();
+
+  // Prebuilt frames should be sent as is.
+  static constexpr auto kFrame = jvsio::BuildFrame(
+      1, jvsio::DriverOutput(std::array<uint8_t, 2>{kSync, kMarker}));
+  uint8_t id = jvsio::Submit(kFrame, 0, GetTick() + 100);
+  ASSERT_NE(0, id);
+  EXPECT_EQ(0, JVSIO_Host_submitFrame(&kFrame.bytes[1], kFrame.size - 1, 0,
+                                      GetTick() + 100));
+  ASSERT_TRUE(RunUntilReady());
+  ASSERT_EQ(1u, GetTransactions().size());
+  EXPECT_EQ(id, GetTransactions()[0].id);
+  EXPECT_EQ(std::vector<uint8_t>({0x01, kReportOk}),
+            GetTransactions()[0].status);
+  EXPECT_EQ(std::vector<uint8_t>({kSync, kMarker}), GetDevice(0).gpo);
+  EXPECT_EQ(1u, TakeRequestCount());
+}
+
+TEST_F(HostTest, Outputs) {
+  AddDevice();
+  ASSERT_TRUE(RunUntilReady());
+
+  // Outputs should be sent once after the enumeration.
+  ASSERT_TRUE(Sync());
+  ASSERT_EQ(std::vector<uint8_t>({0x00, 0x00}), GetDevice(0).gpo);
+  ASSERT_EQ(std::vector<uint8_t>({0x00, 0x00, 0x00, 0x00}),
+            GetDevice(0).analog);
+  TakeRequestCount();
+  ASSERT_TRUE(Sync());
+  ASSERT_EQ(1u, GetRequests().size());
+  EXPECT_EQ(6u, GetRequests()[0][1]);
+
+  // Only changed outputs should be sent.
+  const uint8_t kGpo[] = {0x12, 0x34};
+  JVSIO_Host_setGeneralPurposeOutput(1, kGpo, sizeof(kGpo));
+  TakeRequestCount();
+  ASSERT_TRUE(Sync());
+  ASSERT_EQ(1u, GetRequests().size());
+  EXPECT_EQ(10u, GetRequests()[0][1]);
+  EXPECT_EQ(std::vector<uint8_t>({0x12, 0x34}), GetDevice(0).gpo);
+
+  JVSIO_Host_setGeneralPurposeOutput(1, kGpo, sizeof(kGpo));
+  JVSIO_Host_setAnalogOutput(1, 1, 0xabcd);
+  TakeRequestCount();
+  ASSERT_TRUE(Sync());
+  ASSERT_EQ(1u, GetRequests().size());
+  EXPECT_EQ(12u, GetRequests()[0][1]);
+  EXPECT_EQ(kCmdAnalogOutput, GetRequests()[0][7]);
+  EXPECT_EQ(std::vector<uint8_t>({0x00, 0x00, 0xab, 0xcd}),
+            GetDevice(0).analog);
+}
+
+TEST_F(HostTest, ResponseTimeout) {
+  AddDevice();
+  ASSERT_TRUE(RunUntilReady());
+  TakeRequestCount();
+
+  // A missing device should be detected within several milliseconds at
+  // 115200bps, and the host should reset the bus after 500 milliseconds as
+  // the sense line shows the topology change.
+  TurnOff(0);
+  JVSIO_Host_sync();
+  for (int i = 0; i < 1000 && GetRequests().size() < 2; ++i) {
+    JVSIO_Host_run();
+    AdvanceTick(1);
+  }
+  ASSERT_EQ(2u, GetRequests().size());
+  EXPECT_EQ(kCmdSwInput, GetRequests()[0][2]);
+  EXPECT_EQ(kCmdReset, GetRequests()[1][2]);
+  uint32_t elapsed = GetRequestTicks()[1] - GetRequestTicks()[0];
+  EXPECT_LT(500u, elapsed);
+  EXPECT_GT(520u, elapsed);
+}
+
+TEST_F(HostTest, Wait) {
+  uint32_t deadline;
+  SetConnected(false);
+  EXPECT_EQ(kHostWaitConnection, JVSIO_Host_getWait(&deadline));
+  SetConnected(true);
+  EXPECT_EQ(kHostWaitNone, JVSIO_Host_getWait(&deadline));
+
+  AddDevice();
+  AddDevice();
+  size_t runs = RunWithWaitsUntilReady();
+  ASSERT_NE(0u, runs);
+  EXPECT_GT(50u, runs);
+  EXPECT_EQ(2u, GetIoIds().size());
+  EXPECT_EQ(kHostWaitRequest, JVSIO_Host_getWait(&deadline));
+
+  // Waits for the response to time out, and for the interval before RESET.
+  TurnOff(1);
+  TakeRequestCount();
+  JVSIO_Host_sync();
+  while (JVSIO_Host_getWait(&deadline) == kHostWaitNone ||
+         IsDataAvailable()) {
+    JVSIO_Host_run();
+  }
+  ASSERT_EQ(2u, GetRequests().size());
+  ASSERT_EQ(kHostWaitData, JVSIO_Host_getWait(&deadline));
+  EXPECT_LT(GetTick(), deadline);
+  EXPECT_GT(GetTick() + 20, deadline);
+  AdvanceTick(deadline - GetTick());
+  do {
+    JVSIO_Host_run();
+  } while (JVSIO_Host_getWait(&deadline) == kHostWaitNone);
+  ASSERT_EQ(kHostWaitTimer, JVSIO_Host_getWait(&deadline));
+  EXPECT_EQ(GetTick() + 501, deadline);
+  EXPECT_EQ(2u, GetRequests().size());
+}
+
+TEST_F(HostTest, SyncRecovery) {
+  AddDevice();
+  AddDevice();
+  ASSERT_TRUE(RunUntilReady());
+  TakeRequestCount();
+
+  // A dropped response is retried without resetting the bus.
+  GetDevice(0).drops = 1;
+  GetDevice(0).sw[1] = 0x80;
+  ASSERT_TRUE(Sync());
+  ASSERT_EQ(3u, GetRequests().size());
+  EXPECT_EQ(1u, GetRequests()[0][0]);
+  EXPECT_EQ(1u, GetRequests()[1][0]);
+  EXPECT_EQ(2u, GetRequests()[2][0]);
+  EXPECT_EQ(0x80, GetSyncedSwState0()[0]);
+  EXPECT_FALSE(JVSIO_Host_isDegraded(1));
+  TakeRequestCount();
+
+  // A device that keeps failing is retried, queried, and marked as degraded
+  // while others are polled as usual.
+  JVSIO_InputEvent event;
+  while (JVSIO_Host_popInputEvent(&event))
+    ;
+  GetDevice(0).alive = false;
+  ASSERT_TRUE(Sync());
+  ASSERT_EQ(5u, GetRequests().size());
+  for (size_t i = 0; i < 3; ++i) {
+    EXPECT_EQ(1u, GetRequests()[i][0]);
+    EXPECT_EQ(kCmdSwInput, GetRequests()[i][2]);
+  }
+  EXPECT_EQ(1u, GetRequests()[3][0]);
+  EXPECT_EQ(kCmdIoId, GetRequests()[3][2]);
+  EXPECT_EQ(2u, GetRequests()[4][0]);
+  EXPECT_TRUE(JVSIO_Host_isDegraded(1));
+  EXPECT_FALSE(JVSIO_Host_isDegraded(2));
+  EXPECT_EQ(0x00, GetSyncedSwState0()[0]);
+  // The held button is released for event consumers too.
+  ASSERT_TRUE(JVSIO_Host_popInputEvent(&event));
+  EXPECT_EQ(kInputRelease, event.type);
+  EXPECT_EQ(1u, event.address);
+  EXPECT_EQ(1u, event.player);
+  EXPECT_EQ(0u, event.index);
+  EXPECT_FALSE(JVSIO_Host_popInputEvent(&event));
+  TakeRequestCount();
+
+  ASSERT_TRUE(Sync());
+  ASSERT_EQ(1u, GetRequests().size());
+  EXPECT_EQ(2u, GetRequests()[0][0]);
+
+  // The degraded device is probed in later syncs, and recovers.
+  GetDevice(0).alive = true;
+  for (int i = 0; i < JVSIO_HOST_DEGRADED_INTERVAL && JVSIO_Host_isDegraded(1);
+       ++i) {
+    ASSERT_TRUE(Sync());
+  }
+  EXPECT_FALSE(JVSIO_Host_isDegraded(1));
+  EXPECT_EQ(0x80, GetSyncedSwState0()[0]);
+  // The first sync after the recovery presses the button again.
+  ASSERT_TRUE(JVSIO_Host_popInputEvent(&event));
+  EXPECT_EQ(kInputPress, event.type);
+  EXPECT_EQ(1u, event.player);
+  EXPECT_EQ(0u, event.index);
+  EXPECT_FALSE(JVSIO_Host_popInputEvent(&event));
+  for (const auto& request : GetRequests())
+    EXPECT_NE(kBroadcastAddress, request[0]);
+}
+
+TEST_F(HostTest, ResponseTimeoutSize) {
+  AddDevice();
+  ASSERT_TRUE(RunUntilReady());
+  // Outputs are sent in the first sync.
+  ASSERT_TRUE(Sync());
+  TakeRequestCount();
+
+  // The response is 5 + 11 bytes for 2 players in 2 bytes and 2 coin slots,
+  // and one in eight bytes may be escaped. Each byte takes 86.8 usec at
+  // 115200bps, in addition to the 2000 usec turnaround.
+  const uint32_t kTimeout = 2000 + (5 + 11 + 2) * 868 / 10;
+  GetDevice(0).drops = 1;
+  JVSIO_Host_sync();
+  JVSIO_Host_run();
+  ASSERT_EQ(1u, GetRequests().size());
+  ASSERT_EQ(6u, GetRequests()[0][1]);
+  uint32_t elapsed = 0;
+  for (; elapsed <= kTimeout + 1 && GetRequests().size() < 2; ++elapsed) {
+    AdvanceMicroseconds(1);
+    for (int i = 0; i < 3; ++i)
+      JVSIO_Host_run();
+  }
+  // The request is retried right after the timeout, and a missing board costs
+  // about 3.5 msec.
+  ASSERT_EQ(2u, GetRequests().size());
+  EXPECT_EQ(kTimeout + 1, elapsed);
+  EXPECT_GT(3600u, elapsed);
+}
+
+TEST_F(HostTest, SyncReport) {
+  AddDevice();
+  ASSERT_TRUE(RunUntilReady());
+
+  Device& device = GetDevice(0);
+  device.sw[0] = 0x80;
+  device.sw[1] = 0x12;
+  device.sw[2] = 0x34;
+  device.sw[3] = 0x56;
+  device.sw[4] = 0x78;
+  device.coins[1] = 0x4003;
+  ASSERT_TRUE(Sync());
+  ASSERT_EQ(1u, GetSyncReports().size());
+  const JVSIO_SyncReport& report = GetSyncReports()[0];
+  const std::vector<uint8_t>& data = GetSyncReportData()[0];
+  EXPECT_EQ(2u, report.players);
+  EXPECT_EQ(2u, report.switch_bytes);
+  EXPECT_EQ(2u, report.coin_slots);
+  EXPECT_EQ(0x01, data[0]);
+  EXPECT_EQ(kReportOk, data[report.switch_offset - 1]);
+  EXPECT_EQ(0x80, data[report.switch_offset]);
+  EXPECT_EQ(0x56, data[report.switch_offset + 3]);
+  EXPECT_EQ(0x78, data[report.switch_offset + 4]);
+  EXPECT_EQ(kReportOk, data[report.coin_offset - 1]);
+  EXPECT_EQ(0x40, data[report.coin_offset + 2]);
+  EXPECT_EQ(0x03, data[report.coin_offset + 3]);
+}
+
+TEST_F(HostTest, InputEvents) {
+  AddDevice();
+  ASSERT_TRUE(RunUntilReady());
+  ASSERT_TRUE(Sync());
+  JVSIO_InputEvent event;
+  EXPECT_FALSE(JVSIO_Host_popInputEvent(&event));
+
+  Device& device = GetDevice(0);
+  device.sw[0] = 0x80;
+  device.sw[4] = 0x41;
+  device.coins[1] = 2;
+  uint32_t tick = GetTick();
+  ASSERT_TRUE(Sync());
+
+  ASSERT_TRUE(JVSIO_Host_popInputEvent(&event));
+  EXPECT_EQ(kInputPress, event.type);
+  EXPECT_EQ(1u, event.address);
+  EXPECT_EQ(0u, event.player);
+  EXPECT_EQ(0u, event.index);
+  EXPECT_LE(tick, event.tick);
+  ASSERT_TRUE(JVSIO_Host_popInputEvent(&event));
+  EXPECT_EQ(kInputPress, event.type);
+  EXPECT_EQ(2u, event.player);
+  EXPECT_EQ(9u, event.index);
+  ASSERT_TRUE(JVSIO_Host_popInputEvent(&event));
+  EXPECT_EQ(kInputPress, event.type);
+  EXPECT_EQ(2u, event.player);
+  EXPECT_EQ(15u, event.index);
+  ASSERT_TRUE(JVSIO_Host_popInputEvent(&event));
+  EXPECT_EQ(kInputCoin, event.type);
+  EXPECT_EQ(2u, event.player);
+  EXPECT_EQ(2u, event.index);
+  EXPECT_FALSE(JVSIO_Host_popInputEvent(&event));
+
+  device.sw[4] = 0x01;
+  ASSERT_TRUE(Sync());
+  ASSERT_TRUE(JVSIO_Host_popInputEvent(&event));
+  EXPECT_EQ(kInputRelease, event.type);
+  EXPECT_EQ(2u, event.player);
+  EXPECT_EQ(9u, event.index);
+  EXPECT_FALSE(JVSIO_Host_popInputEvent(&event));
+}
+
+TEST_F(HostTest, InputEventsAfterCoinSub) {
+  AddDevice();
+  ASSERT_TRUE(RunUntilReady());
+  ASSERT_TRUE(Sync());
+  Device& device = GetDevice(0);
+  JVSIO_InputEvent event;
+
+  // The host subtracts the coin in the sync.
+  device.coins[0] = 1;
+  ASSERT_TRUE(Sync());
+  EXPECT_EQ(0u, device.coins[0]);
+  ASSERT_TRUE(JVSIO_Host_popInputEvent(&event));
+  EXPECT_EQ(kInputCoin, event.type);
+  EXPECT_EQ(1u, event.player);
+  EXPECT_EQ(1u, event.index);
+
+  // Another coin before the next sync should be notified.
+  device.coins[0] = 1;
+  ASSERT_TRUE(Sync());
+  ASSERT_TRUE(JVSIO_Host_popInputEvent(&event));
+  EXPECT_EQ(kInputCoin, event.type);
+  EXPECT_EQ(1u, event.player);
+  EXPECT_EQ(1u, event.index);
+  EXPECT_FALSE(JVSIO_Host_popInputEvent(&event));
+}
@@ -0,0 +1,28 @@
+// Copyright 2023 Takashi Toyoshima <toyoshim@gmail.com>.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#if !defined(__INLINE_IO_H__)
+#define __INLINE_IO_H__
+
+#include <stdint.h>
+
+// A config header for node_inline_test, that binds the byte-wise hooks to
+// the test queues in both forms of a macro and static inline functions.
+#define JVSIO_INLINE_IO
+
+int TestIo_isDataAvailable(void);
+void TestIo_send(uint8_t data);
+uint8_t TestIo_receive(void);
+
+#define JVSIO_Client_isDataAvailable() TestIo_isDataAvailable()
+
+static inline void JVSIO_Client_send(uint8_t data) {
+  TestIo_send(data);
+}
+
+static inline uint8_t JVSIO_Client_receive(void) {
+  return TestIo_receive();
+}
+
+#endif  // !defined(__INLINE_IO_H__)
@@ -46,6 +46,18 @@ class ClientTest : public ::testing::Test {
     fprintf(stderr, "\n");
   }
   static void SetSense(bool ready) { instance->SetReady(ready); }
+  static void WillReceive() { instance->will_receive_++; }
+#if defined(JVSIO_NODE_ASYNC_TX)
+  static void StartSending() {
+    if (!instance->defer_sending_)
+      instance->PullBytes();
+  }
+#endif
+  static uint32_t GetMicroseconds() { return instance->microseconds_; }
+  static void Delay(unsigned int usec) {
+    instance->delays_.push_back(usec);
+    instance->microseconds_ += usec;
+  }
   static bool ReceiveCommand(uint8_t node,
                              uint8_t* command,
                              uint8_t len,
@@ -67,6 +79,38 @@ class ClientTest : public ::testing::Test {
     }
     return true;
   }
+#if defined(JVSIO_NODE_BATCH)
+  static bool ReceiveCommands(uint8_t node,
+                              const struct JVSIO_Command* commands,
+                              uint8_t count,
+                              uint8_t* report,
+                              uint8_t size,
+                              uint8_t* len) {
+    instance->dispatches_++;
+    *len = 0;
+    for (uint8_t i = 0; i < count; ++i) {
+      EXPECT_EQ(commands[i].data[0], commands[i].opcode);
+      Command data;
+      data.node = node;
+      data.command.assign(commands[i].data,
+                          commands[i].data + commands[i].len);
+      data.commit = true;
+      instance->received_commands_.push_back(data);
+      if (instance->report_.empty()) {
+        return false;
+      }
+      auto reports = instance->report_.front();
+      instance->report_.pop();
+      for (uint8_t c : reports) {
+        if (*len < size)
+          report[*len] = c;
+        if (*len < 255)
+          (*len)++;
+      }
+    }
+    return true;
+  }
+#endif
 
  protected:
   struct Command {
@@ -85,6 +129,15 @@ class ClientTest : public ::testing::Test {
   }
 
   void SetCommand(uint8_t address, const uint8_t* command, uint8_t size) {
+    ASSERT_TRUE(incoming_data_.empty());
+    for (uint8_t c : BuildCommand(address, command, size)) {
+      incoming_data_.push(c);
+    }
+  }
+
+  std::vector<uint8_t> BuildCommand(uint8_t address,
+                                    const uint8_t* command,
+                                    uint8_t size) {
     std::vector<uint8_t> data;
     uint8_t sum = address + size + 1;
     data.push_back(address);
@@ -95,16 +148,16 @@ class ClientTest : public ::testing::Test {
     }
     data.push_back(sum);
 
-    ASSERT_TRUE(incoming_data_.empty());
-    incoming_data_.push(kSync);
+    std::vector<uint8_t> packet = {kSync};
     for (const auto& c : data) {
       if (c == kSync || c == kMarker) {
-        incoming_data_.push(kMarker);
-        incoming_data_.push(c - 1);
+        packet.push_back(kMarker);
+        packet.push_back(c - 1);
       } else {
-        incoming_data_.push(c);
+        packet.push_back(c);
       }
     }
+    return packet;
   }
 
   bool IsIncomingDataEmpty() { return incoming_data_.empty(); }
@@ -149,14 +202,26 @@ class ClientTest : public ::testing::Test {
 
   void PushReport(std::vector<uint8_t> report) { report_.push(report); }
 
+#if defined(JVSIO_NODE_ASYNC_TX)
+  void SetDeferSending(bool defer) { defer_sending_ = defer; }
+  void PullBytes() {
+    uint8_t data;
+    while (JVSIO_Node_pullByte(&data))
+      WriteData(data);
+  }
+#endif
+  int GetWillReceiveCount() { return will_receive_; }
+  int GetDispatchCount() { return dispatches_; }
+
+  void AdvanceMicroseconds(uint32_t usec) { microseconds_ += usec; }
+  std::vector<unsigned int>& GetDelays() { return delays_; }
+
  private:
   void SetUp() override {
-    JVSIO_Node_init(1);
     instance = this;
+    JVSIO_Node_init(1);
   }
 
-  static void Delay(unsigned int time) {}
-
  private:
   bool ready_ = false;
   std::queue<uint8_t> incoming_data_;
@@ -164,6 +229,11 @@ class ClientTest : public ::testing::Test {
   std::vector<Command> received_commands_;
   std::queue<std::vector<uint8_t>> report_;
   bool outgoing_marked_ = false;
+  bool defer_sending_ = false;
+  int will_receive_ = 0;
+  int dispatches_ = 0;
+  uint32_t microseconds_ = 0;
+  std::vector<unsigned int> delays_;
 
   static ClientTest* instance;
 };
@@ -171,37 +241,85 @@ class ClientTest : public ::testing::Test {
 ClientTest* ClientTest::instance = nullptr;
 
 extern "C" {
+#if defined(JVSIO_BULK_IO)
+void JVSIO_Client_sendBytes(const uint8_t* data, uint16_t len) {
+  for (uint16_t i = 0; i < len; ++i)
+    ClientTest::WriteData(data[i]);
+}
+uint16_t JVSIO_Client_receiveBytes(uint8_t* data, uint16_t len) {
+  uint16_t size = 0;
+  for (; size < len && ClientTest::IsDataAvailable(); ++size)
+    data[size] = ClientTest::ReadData();
+  return size;
+}
+#elif defined(JVSIO_INLINE_IO)
+int TestIo_isDataAvailable() {
+  return ClientTest::IsDataAvailable();
+}
+void TestIo_send(uint8_t data) {
+  ClientTest::WriteData(data);
+}
+uint8_t TestIo_receive() {
+  return ClientTest::ReadData();
+}
+#else
 int JVSIO_Client_isDataAvailable() {
   return ClientTest::IsDataAvailable();
 }
-void JVSIO_Client_willSend() {}
-void JVSIO_Client_willReceive() {}
 void JVSIO_Client_send(uint8_t data) {
   ClientTest::WriteData(data);
 }
 uint8_t JVSIO_Client_receive() {
   return ClientTest::ReadData();
 }
+#endif
+void JVSIO_Client_willSend() {}
+void JVSIO_Client_willReceive() {
+  ClientTest::WillReceive();
+}
 void JVSIO_Client_dump(const char* str, uint8_t* data, uint8_t len) {
   ClientTest::Dump(str, data, len);
 }
 bool JVSIO_Client_isSenseReady() {
   return true;
 }
+#if defined(JVSIO_NODE_BATCH)
+bool JVSIO_Client_receiveCommands(uint8_t node,
+                                  const struct JVSIO_Command* commands,
+                                  uint8_t count,
+                                  uint8_t* report,
+                                  uint8_t size,
+                                  uint8_t* len) {
+  return ClientTest::ReceiveCommands(node, commands, count, report, size, len);
+}
+#else
 bool JVSIO_Client_receiveCommand(uint8_t node,
                                  uint8_t* command,
                                  uint8_t len,
                                  bool commit) {
   return ClientTest::ReceiveCommand(node, command, len, commit);
 }
+#endif
+#if !defined(JVSIO_COMM_115200_ONLY)
 bool JVSIO_Client_setCommSupMode(enum JVSIO_CommSupMode mode, bool dryrun) {
   return false;
 }
+#endif
 void JVSIO_Client_setSense(bool ready) {
   ClientTest::SetSense(ready);
 }
 void JVSIO_Client_setLed(bool ready) {}
-void JVSIO_Client_delayMicroseconds(unsigned int usec) {}
+#if defined(JVSIO_NODE_ASYNC_TX)
+void JVSIO_Client_startSending() {
+  ClientTest::StartSending();
+}
+#endif
+void JVSIO_Client_delayMicroseconds(unsigned int usec) {
+  ClientTest::Delay(usec);
+}
+uint32_t JVSIO_Client_getMicroseconds() {
+  return ClientTest::GetMicroseconds();
+}
 }  // extern "C"
 
 TEST_F(ClientTest, DoNothing) {
@@ -547,6 +665,8 @@ TEST_F(ClientTest, PartialCommandVerified) {
   EXPECT_EQ(0x25, GetReceivedCommands()[4].command[0]);
 }
 
+#if !defined(JVSIO_NODE_SPECULATIVE) || JVSIO_NODE_SPECULATIVE
+// Speculative mode is not available with JVSIO_SHARED_BUFFER.
 TEST_F(ClientTest, PartialCommandSpeculative) {
   SetUpAddress();
 
@@ -608,4 +728,303 @@ TEST_F(ClientTest, PartialCommandSpeculative) {
   uint8_t status = RetrieveStatus(reports);
   EXPECT_EQ(0x01, status);
   EXPECT_EQ(5u, reports.size());
-}
\ No newline at end of file
+}
+#endif  // !defined(JVSIO_NODE_SPECULATIVE) || JVSIO_NODE_SPECULATIVE
+
+#if JVSIO_NODE_MAX > 1
+TEST_F(ClientTest, MultiNodes) {
+  JVSIO_Node_init(2);
+  ASSERT_FALSE(IsReady());
+
+  // The sense signal should be ready only after all nodes get addresses.
+  const uint8_t kAddressSetCommand1[] = {kCmdAddressSet, 0x01};
+  SetCommand(kBroadcastAddress, kAddressSetCommand1,
+             sizeof(kAddressSetCommand1));
+  JVSIO_Node_run(false);
+  EXPECT_FALSE(IsReady());
+
+  std::vector<uint8_t> reports;
+  EXPECT_EQ(0x01, RetrieveStatus(reports));
+
+  const uint8_t kAddressSetCommand2[] = {kCmdAddressSet, 0x02};
+  SetCommand(kBroadcastAddress, kAddressSetCommand2,
+             sizeof(kAddressSetCommand2));
+  JVSIO_Node_run(false);
+  EXPECT_TRUE(IsReady());
+  EXPECT_EQ(0x01, RetrieveStatus(reports));
+
+  // Commands should be dispatched to the node that owns the address.
+  const uint8_t kCommand[] = {0x21, 0x02};
+  PushReport({kReportOk, 0x01});
+  SetCommand(0x02, kCommand, sizeof(kCommand));
+  JVSIO_Node_run(false);
+  EXPECT_EQ(0x01, RetrieveStatus(reports));
+
+  PushReport({kReportOk, 0x01});
+  SetCommand(0x01, kCommand, sizeof(kCommand));
+  JVSIO_Node_run(false);
+  EXPECT_EQ(0x01, RetrieveStatus(reports));
+
+  // Packets for unknown addresses should be ignored.
+  SetCommand(0x03, kCommand, sizeof(kCommand));
+  JVSIO_Node_run(false);
+  EXPECT_TRUE(IsOutgoingDataEmpty());
+
+  ASSERT_EQ(2u, GetReceivedCommands().size());
+  EXPECT_EQ(1u, GetReceivedCommands()[0].node);
+  EXPECT_EQ(0u, GetReceivedCommands()[1].node);
+
+  // Reset should release all addresses.
+  const uint8_t kResetCommand[] = {kCmdReset, 0xd9};
+  SetCommand(kBroadcastAddress, kResetCommand, sizeof(kResetCommand));
+  JVSIO_Node_run(false);
+  EXPECT_FALSE(IsReady());
+  SetCommand(0x01, kCommand, sizeof(kCommand));
+  JVSIO_Node_run(false);
+  EXPECT_TRUE(IsOutgoingDataEmpty());
+}
+#endif  // JVSIO_NODE_MAX > 1
+
+TEST_F(ClientTest, ReportOverflow) {
+  SetUpAddress();
+
+  const uint8_t kCommand[] = {0x21, 0x02};
+  SetCommand(kClientAddress, kCommand, sizeof(kCommand));
+  PushReport(std::vector<uint8_t>(254, kReportOk));
+  JVSIO_Node_run(false);
+
+  std::vector<uint8_t> reports;
+  EXPECT_EQ(0x04, RetrieveStatus(reports));
+  EXPECT_EQ(0u, reports.size());
+}
+
+TEST_F(ClientTest, TrailingBytes) {
+  SetUpAddress();
+
+  // Bytes after the checksum should be ignored until the next SYNC, even if
+  // they exceed the receive buffer.
+  const uint8_t kCommand[] = {kCmdSwInput, 0x01, 0x01};
+  SetCommand(kClientAddress, kCommand, sizeof(kCommand));
+  const std::vector<uint8_t> garbage(200, 0x55);
+  SetRawCommand(garbage.data(), garbage.size());
+  PushReport({kReportOk, 0x00, 0x12});
+  JVSIO_Node_run(false);
+  EXPECT_TRUE(IsIncomingDataEmpty());
+  ASSERT_EQ(1u, GetReceivedCommands().size());
+
+  std::vector<uint8_t> reports;
+  EXPECT_EQ(0x01, RetrieveStatus(reports));
+  EXPECT_EQ(std::vector<uint8_t>({kReportOk, 0x00, 0x12}), reports);
+}
+
+TEST_F(ClientTest, PushBytes) {
+  SetUpAddress();
+
+  const uint8_t kCommand[] = {0x21, 0x02, 0x20, 0x02, 0x02};
+  std::vector<uint8_t> packet =
+      BuildCommand(kClientAddress, kCommand, sizeof(kCommand));
+  PushReport({kReportOk, 0x00, 0x01, 0x00, 0x00});
+  PushReport({kReportOk, 0x12, 0x34, 0x56, 0x78});
+  EXPECT_EQ(kNodeIdle, JVSIO_Node_getState());
+  for (size_t i = 0; i < packet.size() - 1; ++i) {
+    EXPECT_FALSE(JVSIO_Node_onByte(packet[i], false));
+    EXPECT_EQ(kNodeReceiving, JVSIO_Node_getState());
+  }
+  EXPECT_TRUE(JVSIO_Node_onByte(packet.back(), false));
+  EXPECT_EQ(kNodeResponding, JVSIO_Node_getState());
+  JVSIO_Node_run(false);
+  ASSERT_EQ(2u, GetReceivedCommands().size());
+  EXPECT_EQ(kNodeIdle, JVSIO_Node_getState());
+
+  std::vector<uint8_t> reports;
+  EXPECT_EQ(0x01, RetrieveStatus(reports));
+  EXPECT_EQ(10u, reports.size());
+}
+
+#if !defined(JVSIO_NODE_SPECULATIVE) || JVSIO_NODE_SPECULATIVE
+TEST_F(ClientTest, PushBytesSpeculative) {
+  SetUpAddress();
+
+  const uint8_t kCommand[] = {0x21, 0x02, 0x20, 0x02, 0x02};
+  std::vector<uint8_t> packet =
+      BuildCommand(kClientAddress, kCommand, sizeof(kCommand));
+  PushReport({kReportOk, 0x00, 0x01, 0x00, 0x00});
+  PushReport({kReportOk, 0x12, 0x34, 0x56, 0x78});
+
+  // SYNC, address, size, and the first command are ready to process.
+  size_t i = 0;
+  for (; i < 4; ++i) {
+    EXPECT_FALSE(JVSIO_Node_onByte(packet[i], true));
+  }
+  EXPECT_TRUE(JVSIO_Node_onByte(packet[i++], true));
+  JVSIO_Node_run(true);
+  ASSERT_EQ(1u, GetReceivedCommands().size());
+  EXPECT_FALSE(GetReceivedCommands()[0].commit);
+
+  for (; i < packet.size() - 1; ++i) {
+    EXPECT_FALSE(JVSIO_Node_onByte(packet[i], true));
+  }
+  EXPECT_TRUE(JVSIO_Node_onByte(packet.back(), true));
+  JVSIO_Node_run(true);
+  ASSERT_EQ(2u, GetReceivedCommands().size());
+  EXPECT_TRUE(GetReceivedCommands()[1].commit);
+
+  std::vector<uint8_t> reports;
+  EXPECT_EQ(0x01, RetrieveStatus(reports));
+  EXPECT_EQ(10u, reports.size());
+}
+
+TEST_F(ClientTest, PushBytesSpeculativeUnknown) {
+  SetUpAddress();
+
+  const uint8_t kCommand[] = {0x21, 0x02, 0x22, 0x04, 0x25, 0x01};
+  std::vector<uint8_t> packet =
+      BuildCommand(kClientAddress, kCommand, sizeof(kCommand));
+  // The client knows only the first command.
+  PushReport({kReportOk, 0x00, 0x01, 0x00, 0x00});
+
+  // The unknown command should not block JVSIO_Node_run() until the rest of
+  // the packet arrives.
+  for (size_t i = 0; i < packet.size() - 1; ++i) {
+    if (JVSIO_Node_onByte(packet[i], true))
+      JVSIO_Node_run(true);
+    EXPECT_TRUE(IsOutgoingDataEmpty());
+  }
+  ASSERT_EQ(2u, GetReceivedCommands().size());
+  EXPECT_TRUE(JVSIO_Node_isBusy());
+
+  EXPECT_TRUE(JVSIO_Node_onByte(packet.back(), true));
+  JVSIO_Node_run(true);
+  EXPECT_EQ(2u, GetReceivedCommands().size());
+  EXPECT_FALSE(JVSIO_Node_isBusy());
+
+  std::vector<uint8_t> reports;
+  EXPECT_EQ(0x02, RetrieveStatus(reports));
+}
+#endif  // !defined(JVSIO_NODE_SPECULATIVE) || JVSIO_NODE_SPECULATIVE
+
+TEST_F(ClientTest, ResponseInterval) {
+  SetUpAddress();
+  ASSERT_EQ(1u, GetDelays().size());
+  EXPECT_EQ(100u, GetDelays()[0]);
+  GetDelays().clear();
+
+  // Only the rest of the interval should be waited.
+  const uint8_t kCommand[] = {0x21, 0x02};
+  std::vector<uint8_t> packet =
+      BuildCommand(kClientAddress, kCommand, sizeof(kCommand));
+  std::vector<uint8_t> reports;
+  PushReport({kReportOk, 0x01});
+  for (uint8_t c : packet) {
+    JVSIO_Node_onByte(c, false);
+  }
+  AdvanceMicroseconds(30);
+  JVSIO_Node_run(false);
+  EXPECT_EQ(0x01, RetrieveStatus(reports));
+  ASSERT_EQ(1u, GetDelays().size());
+  EXPECT_EQ(70u, GetDelays()[0]);
+  GetDelays().clear();
+
+  // No wait is needed if command handling took long enough.
+  PushReport({kReportOk, 0x01});
+  for (uint8_t c : packet) {
+    JVSIO_Node_onByte(c, false);
+  }
+  AdvanceMicroseconds(150);
+  JVSIO_Node_run(false);
+  EXPECT_EQ(0x01, RetrieveStatus(reports));
+  EXPECT_TRUE(GetDelays().empty());
+}
+
+TEST_F(ClientTest, EscapedBytes) {
+  SetUpAddress();
+
+  // Mixes runs of plain bytes with bytes to escape.
+  std::vector<uint8_t> command = {kCmdDriverOutput, 40};
+  for (uint8_t i = 0; i < 40; ++i) {
+    if (i % 13 == 5)
+      command.push_back(kMarker);
+    else if (i % 11 == 7)
+      command.push_back(kSync);
+    else
+      command.push_back(i);
+  }
+  SetCommand(kClientAddress, command.data(), command.size());
+  PushReport({kReportOk, 0x01, 0x02, 0x03, 0x04, kMarker, kSync, 0x05});
+  JVSIO_Node_run(false);
+  EXPECT_TRUE(IsIncomingDataEmpty());
+  ASSERT_EQ(1u, GetReceivedCommands().size());
+  EXPECT_EQ(command, GetReceivedCommands()[0].command);
+
+  std::vector<uint8_t> reports;
+  EXPECT_EQ(0x01, RetrieveStatus(reports));
+  EXPECT_EQ(std::vector<uint8_t>(
+                {kReportOk, 0x01, 0x02, 0x03, 0x04, kMarker, kSync, 0x05}),
+            reports);
+}
+
+#if defined(JVSIO_NODE_ASYNC_TX)
+TEST_F(ClientTest, AsyncSend) {
+  SetUpAddress();
+  SetDeferSending(true);
+
+  const uint8_t kCommand[] = {kCmdSwInput, 0x01, 0x02};
+  SetCommand(kClientAddress, kCommand, sizeof(kCommand));
+  PushReport({kReportOk, 0x00, kSync, kMarker});
+  JVSIO_Node_run(false);
+  ASSERT_EQ(1u, GetReceivedCommands().size());
+  EXPECT_TRUE(IsOutgoingDataEmpty());
+
+  // Packets should not be received while the response is being sent.
+  SetCommand(kClientAddress, kCommand, sizeof(kCommand));
+  PushReport({kReportOk, 0x00, 0x00, 0x00});
+  JVSIO_Node_run(false);
+  EXPECT_EQ(1u, GetReceivedCommands().size());
+  EXPECT_EQ(kNodeTransmitting, JVSIO_Node_getState());
+
+  int will_receive = GetWillReceiveCount();
+  PullBytes();
+  EXPECT_EQ(kNodeIdle, JVSIO_Node_getState());
+  EXPECT_EQ(will_receive + 1, GetWillReceiveCount());
+  std::vector<uint8_t> reports;
+  EXPECT_EQ(0x01, RetrieveStatus(reports));
+  EXPECT_EQ(std::vector<uint8_t>({kReportOk, 0x00, kSync, kMarker}), reports);
+
+  JVSIO_Node_run(false);
+  EXPECT_EQ(2u, GetReceivedCommands().size());
+  PullBytes();
+  EXPECT_EQ(0x01, RetrieveStatus(reports));
+  EXPECT_EQ(std::vector<uint8_t>({kReportOk, 0x00, 0x00, 0x00}), reports);
+}
+#endif
+
+#if defined(JVSIO_NODE_BATCH)
+TEST_F(ClientTest, BatchCommands) {
+  SetUpAddress();
+  int dispatches = GetDispatchCount();
+
+  // CommandRev is handled by the library, and splits the batch.
+  const uint8_t kCommand[] = {
+      kCmdSwInput, 0x01, 0x02,  // 1 player, 2 bytes.
+      kCmdCoinInput, 0x01,      // 1 slot.
+      kCmdCommandRev,           //
+      kCmdSwInput, 0x01, 0x01,  // 1 player, 1 byte.
+  };
+  SetCommand(kClientAddress, kCommand, sizeof(kCommand));
+  PushReport({kReportOk, 0x00, 0x12, 0x34});
+  PushReport({kReportOk, 0x00, 0x05});
+  PushReport({kReportOk, 0x00, 0x56});
+  JVSIO_Node_run(false);
+  EXPECT_EQ(dispatches + 2, GetDispatchCount());
+  ASSERT_EQ(3u, GetReceivedCommands().size());
+  EXPECT_EQ(std::vector<uint8_t>({kCmdCoinInput, 0x01}),
+            GetReceivedCommands()[1].command);
+
+  std::vector<uint8_t> reports;
+  EXPECT_EQ(0x01, RetrieveStatus(reports));
+  EXPECT_EQ(std::vector<uint8_t>({kReportOk, 0x00, 0x12, 0x34, kReportOk, 0x00,
+                                  0x05, kReportOk, 0x13, kReportOk, 0x00,
+                                  0x56}),
+            reports);
+}
+#endif
@@ -0,0 +1,315 @@
+// Copyright 2023 Takashi Toyoshima <toyoshim@gmail.com>.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Emulates a long daisy chain of nodes in a child process, and measures the
+// host enumeration and sync throughput against it.
+//
+// Usage: chain [-n nodes] [-f profile,...] [-s usec] [-j usec]
+//              [-w percent:usec] [-m mode] [-t sec] [-b]
+//   -n nodes    Nodes on the chain, up to JVSIO_NODE_MAX (default 31).
+//   -f profile  FunctionCheck profiles in players:buttons:coins, that are
+//               assigned to nodes in turn (default 2:13:2).
+//   -s usec     Delay for the sense line to be ready (default 0).
+//   -j usec     Maximum random delay before each response (default 0).
+//   -w p:usec   Delays `p` percent of responses by `usec` more (default none).
+//   -m mode     Comm mode in 115200, 1M, or 3M (default 115200).
+//   -t sec      Duration to measure syncs (default 2).
+//   -b          Enable batched enumeration.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "jvsio_common.h"
+#include "jvsio_host.h"
+#include "jvsio_node.h"
+#include "link.h"
+
+enum {
+  kMaxProfiles = 8,
+  kEnumerationTimeout = 10,  // in sec.
+};
+
+struct Profile {
+  uint8_t players;
+  uint8_t buttons;
+  uint8_t coins;
+};
+
+// Written by the node process.
+struct Timings {
+  volatile uint64_t last_address;
+};
+
+static const char* mode_names[] = {"115200", "1M", "3M"};
+
+static struct Profile profiles[kMaxProfiles] = {{2, 13, 2}};
+static int profile_size = 1;
+static uint32_t jitter;
+static uint32_t slow_percent;
+static uint32_t slow_delay;
+static struct Timings* timings;
+
+static enum Link_Role role;
+static uint64_t reset_time;
+static uint64_t io_id_time;
+static uint32_t devices;
+static uint32_t resets;
+static uint32_t syncs;
+
+static void delayResponse(void) {
+  uint64_t usec = jitter ? (uint64_t)rand() % (jitter + 1) : 0;
+  if (slow_percent && (uint32_t)rand() % 100 < slow_percent)
+    usec += slow_delay;
+  if (usec)
+    Link_spin(usec * 1000u);
+}
+
+bool JVSIO_Client_receiveCommand(uint8_t node,
+                                 uint8_t* command,
+                                 uint8_t len,
+                                 bool commit) {
+  const struct Profile* profile = &profiles[node % profile_size];
+  switch (*command) {
+    case kCmdReset:
+      Link_setMode(k115200);
+      break;
+    case kCmdIoId: {
+      static const char id[] = "JVSIO;chain;0.1";
+      delayResponse();
+      JVSIO_Node_pushReport(kReportOk);
+      for (size_t i = 0; i < sizeof(id); ++i)
+        JVSIO_Node_pushReport(id[i]);
+      break;
+    }
+    case kCmdFunctionCheck:
+      delayResponse();
+      JVSIO_Node_pushReport(kReportOk);
+      if (profile->players) {
+        JVSIO_Node_pushReport(0x01);
+        JVSIO_Node_pushReport(profile->players);
+        JVSIO_Node_pushReport(profile->buttons);
+        JVSIO_Node_pushReport(0);
+      }
+      if (profile->coins) {
+        JVSIO_Node_pushReport(0x02);
+        JVSIO_Node_pushReport(profile->coins);
+        JVSIO_Node_pushReport(0);
+        JVSIO_Node_pushReport(0);
+      }
+      JVSIO_Node_pushReport(0);
+      break;
+    case kCmdSwInput:
+      delayResponse();
+      JVSIO_Node_pushReport(kReportOk);
+      for (uint16_t i = 0; i < 1u + command[1] * command[2]; ++i)
+        JVSIO_Node_pushReport(0);
+      break;
+    case kCmdCoinInput:
+      JVSIO_Node_pushReport(kReportOk);
+      for (uint8_t i = 0; i < command[1] * 2; ++i)
+        JVSIO_Node_pushReport(0);
+      break;
+    default:
+      return false;
+  }
+  return true;
+}
+
+void JVSIO_Client_dump(const char* str, uint8_t* data, uint8_t len) {
+  uint64_t now = Link_now();
+  if (role == kLinkHost && !strcmp(str, "RESET")) {
+    // Nodes fall back to the default speed on RESET.
+    Link_setMode(k115200);
+    JVSIO_Host_setCommSupMode(k115200);
+    reset_time = now;
+    io_id_time = 0;
+    devices = 0;
+    resets++;
+  } else if (role == kLinkNode && !strcmp(str, "address")) {
+    timings->last_address = now;
+  }
+}
+
+void JVSIO_Client_ioIdReceived(uint8_t address, uint8_t* data, uint8_t len) {
+  if (!io_id_time)
+    io_id_time = Link_now();
+  devices++;
+}
+
+void JVSIO_Client_commandRevReceived(uint8_t address, uint8_t rev) {}
+
+void JVSIO_Client_jvRevReceived(uint8_t address, uint8_t rev) {}
+
+void JVSIO_Client_protocolVerReceived(uint8_t address, uint8_t rev) {}
+
+void JVSIO_Client_functionCheckReceived(uint8_t address,
+                                        uint8_t* data,
+                                        uint8_t len) {}
+
+void JVSIO_Client_synced(uint8_t players,
+                         uint8_t coin_state,
+                         uint8_t* sw_state0,
+                         uint8_t* sw_state1) {
+  syncs++;
+}
+
+static void runNode(uint8_t nodes) {
+  role = kLinkNode;
+  Link_setRole(kLinkNode);
+  JVSIO_Node_init(nodes);
+  for (;;)
+    JVSIO_Node_run(true);
+}
+
+static double toMilliseconds(uint64_t nsec) {
+  return nsec / 1000000.0;
+}
+
+static int runHost(uint8_t nodes,
+                   enum JVSIO_CommSupMode mode,
+                   uint32_t duration,
+                   bool batch) {
+  role = kLinkHost;
+  Link_setRole(kLinkHost);
+  JVSIO_Host_init();
+  JVSIO_Host_setBatchEnumeration(batch);
+  uint64_t start = Link_now();
+  while (!JVSIO_Host_run()) {
+    if (Link_now() - start > kEnumerationTimeout * 1000000000ull) {
+      fprintf(stderr, "enumeration did not finish in %d sec\n",
+              kEnumerationTimeout);
+      return EXIT_FAILURE;
+    }
+  }
+  uint64_t ready_time = Link_now();
+
+  printf("nodes        %u (%u identified)\n", nodes, devices);
+  printf("addressing   %8.3f ms  RESET to the last AddressSet\n",
+         toMilliseconds(timings->last_address - reset_time));
+  printf("ready check  %8.3f ms  the last AddressSet to the first IoId\n",
+         toMilliseconds(io_id_time - timings->last_address));
+  printf("identify     %8.3f ms  the first IoId to ready\n",
+         toMilliseconds(ready_time - io_id_time));
+  printf("enumeration  %8.3f ms  RESET to ready (%u RESETs)\n",
+         toMilliseconds(ready_time - reset_time), resets);
+
+  Link_changeMode(mode);
+  resets = 0;
+  syncs = 0;
+  start = Link_now();
+  uint64_t end = start + duration * 1000000000ull;
+  while (Link_now() < end) {
+    if (JVSIO_Host_run()) {
+      // Switch again after RESETs on errors.
+      Link_changeMode(mode);
+      JVSIO_Host_sync();
+    }
+  }
+  printf("sync         %8.3f ms  per sync at %s (%u syncs, %u RESETs)\n",
+         syncs ? toMilliseconds(end - start) / syncs : 0.0, mode_names[mode],
+         syncs, resets);
+  return EXIT_SUCCESS;
+}
+
+static int parseMode(const char* name) {
+  for (int mode = k115200; mode <= k3M; ++mode) {
+    if (!strcmp(name, mode_names[mode]))
+      return mode;
+  }
+  fprintf(stderr, "unknown mode: %s\n", name);
+  exit(EXIT_FAILURE);
+}
+
+static void parseProfiles(char* list) {
+  profile_size = 0;
+  for (char* item = strtok(list, ","); item && profile_size < kMaxProfiles;
+       item = strtok(NULL, ",")) {
+    unsigned int players;
+    unsigned int buttons;
+    unsigned int coins;
+    if (sscanf(item, "%u:%u:%u", &players, &buttons, &coins) != 3 ||
+        players > 4 || buttons > 32 || coins > 4) {
+      fprintf(stderr, "invalid profile: %s\n", item);
+      exit(EXIT_FAILURE);
+    }
+    profiles[profile_size].players = players;
+    profiles[profile_size].buttons = buttons;
+    profiles[profile_size].coins = coins;
+    profile_size++;
+  }
+}
+
+int main(int argc, char** argv) {
+  uint32_t nodes = JVSIO_NODE_MAX;
+  uint32_t sense_delay = 0;
+  int mode = k115200;
+  uint32_t duration = 2;
+  bool batch = false;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:f:s:j:w:m:t:b")) != -1) {
+    switch (opt) {
+      case 'n':
+        nodes = strtoul(optarg, NULL, 10);
+        break;
+      case 'f':
+        parseProfiles(optarg);
+        break;
+      case 's':
+        sense_delay = strtoul(optarg, NULL, 10);
+        break;
+      case 'j':
+        jitter = strtoul(optarg, NULL, 10);
+        break;
+      case 'w':
+        if (sscanf(optarg, "%u:%u", &slow_percent, &slow_delay) != 2) {
+          fprintf(stderr, "invalid slow responders: %s\n", optarg);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'm':
+        mode = parseMode(optarg);
+        break;
+      case 't':
+        duration = strtoul(optarg, NULL, 10);
+        break;
+      case 'b':
+        batch = true;
+        break;
+      default:
+        fprintf(stderr,
+                "usage: %s [-n nodes] [-f profile,...] [-s usec] [-j usec] "
+                "[-w percent:usec] [-m mode] [-t sec] [-b]\n",
+                argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+  if (!nodes || nodes > JVSIO_NODE_MAX) {
+    fprintf(stderr, "nodes should be in 1 to %d\n", JVSIO_NODE_MAX);
+    return EXIT_FAILURE;
+  }
+
+  Link_init();
+  Link_setSenseDelay(sense_delay);
+  timings = Link_allocateShared(sizeof(*timings));
+  memset((void*)timings, 0, sizeof(*timings));
+
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid < 0) {
+    perror("fork");
+    return EXIT_FAILURE;
+  }
+  if (pid == 0) {
+    runNode(nodes);
+    return EXIT_SUCCESS;
+  }
+  int result = runHost(nodes, mode, duration, batch);
+  Link_close();
+  waitpid(pid, NULL, 0);
+  return result;
+}
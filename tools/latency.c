@@ -0,0 +1,246 @@
+// Copyright 2023 Takashi Toyoshima <toyoshim@gmail.com>.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Measures the latency from a switch change on a node to
+// JVSIO_Client_synced() on the host, for each pair of a sync rate and a comm
+// mode. The node runs in a child process, and toggles the start button of the
+// player 1 at scheduled times that are not aligned with syncs.
+//
+// Usage: latency [-n samples] [-r rate,...] [-m mode,...]
+//   -n samples  Samples for each pair (default 100).
+//   -r rate     Sync rates in Hz (default 60,120,240).
+//   -m mode     Comm modes in 115200, 1M, or 3M (default all).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "jvsio_common.h"
+#include "jvsio_host.h"
+#include "jvsio_node.h"
+#include "link.h"
+
+enum {
+  kMaxRates = 8,
+  kToggleBit = 0x80,
+};
+
+struct Schedule {
+  volatile bool pending;  // Toggled, but not detected yet.
+  volatile uint8_t state;
+  volatile uint64_t next_toggle;
+  volatile uint64_t toggle_time;
+};
+
+static const char* mode_names[] = {"115200", "1M", "3M"};
+
+static struct Schedule* schedule;
+static uint32_t* samples;
+static uint32_t sample_size;
+static uint32_t sample_count;
+static uint64_t sync_period;
+
+static void scheduleToggle(void) {
+  // Toggle at a random phase against syncs.
+  schedule->next_toggle =
+      Link_now() + sync_period * 2 + (uint64_t)rand() % sync_period;
+}
+
+bool JVSIO_Client_receiveCommand(uint8_t node,
+                                 uint8_t* command,
+                                 uint8_t len,
+                                 bool commit) {
+  switch (*command) {
+    case kCmdIoId: {
+      static const char id[] = "JVSIO;latency;0.1";
+      JVSIO_Node_pushReport(kReportOk);
+      for (size_t i = 0; i < sizeof(id); ++i)
+        JVSIO_Node_pushReport(id[i]);
+      break;
+    }
+    case kCmdFunctionCheck: {
+      static const uint8_t functions[] = {0x01, 2, 13, 0, 0x02, 2, 0, 0, 0};
+      JVSIO_Node_pushReport(kReportOk);
+      for (size_t i = 0; i < sizeof(functions); ++i)
+        JVSIO_Node_pushReport(functions[i]);
+      break;
+    }
+    case kCmdSwInput:
+      JVSIO_Node_pushReport(kReportOk);
+      JVSIO_Node_pushReport(0);
+      for (uint8_t player = 0; player < command[1]; ++player) {
+        for (uint8_t i = 0; i < command[2]; ++i)
+          JVSIO_Node_pushReport(player == 0 && i == 0 ? schedule->state : 0);
+      }
+      break;
+    case kCmdCoinInput:
+      JVSIO_Node_pushReport(kReportOk);
+      for (uint8_t slot = 0; slot < command[1]; ++slot) {
+        JVSIO_Node_pushReport(0);
+        JVSIO_Node_pushReport(0);
+      }
+      break;
+    default:
+      return false;
+  }
+  return true;
+}
+
+void JVSIO_Client_dump(const char* str, uint8_t* data, uint8_t len) {}
+
+void JVSIO_Client_ioIdReceived(uint8_t address, uint8_t* data, uint8_t len) {}
+
+void JVSIO_Client_commandRevReceived(uint8_t address, uint8_t rev) {}
+
+void JVSIO_Client_jvRevReceived(uint8_t address, uint8_t rev) {}
+
+void JVSIO_Client_protocolVerReceived(uint8_t address, uint8_t rev) {}
+
+void JVSIO_Client_functionCheckReceived(uint8_t address,
+                                        uint8_t* data,
+                                        uint8_t len) {}
+
+void JVSIO_Client_synced(uint8_t players,
+                         uint8_t coin_state,
+                         uint8_t* sw_state0,
+                         uint8_t* sw_state1) {
+  uint64_t now = Link_now();
+  if (!schedule->pending || (sw_state0[0] & kToggleBit) != schedule->state)
+    return;
+  if (sample_count < sample_size)
+    samples[sample_count++] = (now - schedule->toggle_time) / 1000u;
+  schedule->pending = false;
+  scheduleToggle();
+}
+
+static void runNode(void) {
+  Link_setRole(kLinkNode);
+  JVSIO_Node_init(1);
+  for (;;) {
+    JVSIO_Node_run(true);
+    if (!schedule->pending && schedule->next_toggle &&
+        Link_now() >= schedule->next_toggle) {
+      schedule->toggle_time = Link_now();
+      schedule->state ^= kToggleBit;
+      schedule->pending = true;
+    }
+  }
+}
+
+static int compare(const void* a, const void* b) {
+  uint32_t x = *(const uint32_t*)a;
+  uint32_t y = *(const uint32_t*)b;
+  return (x > y) - (x < y);
+}
+
+static void runHost(uint32_t rate, enum JVSIO_CommSupMode mode) {
+  Link_setRole(kLinkHost);
+  JVSIO_Host_init();
+  while (!JVSIO_Host_run())
+    ;
+  Link_changeMode(mode);
+
+  sync_period = 1000000000u / rate;
+  sample_count = 0;
+  scheduleToggle();
+  uint64_t next_sync = Link_now();
+  while (sample_count < sample_size) {
+    if (Link_now() >= next_sync) {
+      JVSIO_Host_sync();
+      next_sync += sync_period;
+    }
+    JVSIO_Host_run();
+  }
+
+  qsort(samples, sample_count, sizeof(*samples), compare);
+  printf("%-8s %8u %8u %8u %8u %8u\n", mode_names[mode], rate, sample_count,
+         samples[(sample_count - 1) * 50 / 100],
+         samples[(sample_count - 1) * 99 / 100], samples[sample_count - 1]);
+  fflush(stdout);
+}
+
+static void measure(uint32_t rate, enum JVSIO_CommSupMode mode) {
+  Link_init();
+  schedule = Link_allocateShared(sizeof(*schedule));
+  memset((void*)schedule, 0, sizeof(*schedule));
+
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid < 0) {
+    perror("fork");
+    exit(EXIT_FAILURE);
+  }
+  if (pid == 0) {
+    runNode();
+    exit(EXIT_SUCCESS);
+  }
+  runHost(rate, mode);
+  Link_close();
+  waitpid(pid, NULL, 0);
+}
+
+static int parseMode(const char* name) {
+  for (int mode = k115200; mode <= k3M; ++mode) {
+    if (!strcmp(name, mode_names[mode]))
+      return mode;
+  }
+  fprintf(stderr, "unknown mode: %s\n", name);
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char** argv) {
+  uint32_t rates[kMaxRates] = {60, 120, 240};
+  int rate_size = 3;
+  bool modes[k3M + 1] = {true, true, true};
+  sample_size = 100;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:r:m:")) != -1) {
+    switch (opt) {
+      case 'n':
+        sample_size = strtoul(optarg, NULL, 10);
+        break;
+      case 'r':
+        rate_size = 0;
+        for (char* rate = strtok(optarg, ","); rate && rate_size < kMaxRates;
+             rate = strtok(NULL, ",")) {
+          rates[rate_size++] = strtoul(rate, NULL, 10);
+        }
+        break;
+      case 'm':
+        memset(modes, 0, sizeof(modes));
+        for (char* mode = strtok(optarg, ","); mode; mode = strtok(NULL, ","))
+          modes[parseMode(mode)] = true;
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-n samples] [-r rate,...] [-m mode,...]\n",
+                argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+  for (int i = 0; i < rate_size; ++i) {
+    if (!rates[i]) {
+      fprintf(stderr, "invalid rate\n");
+      return EXIT_FAILURE;
+    }
+  }
+  if (!sample_size) {
+    fprintf(stderr, "invalid samples\n");
+    return EXIT_FAILURE;
+  }
+  samples = malloc(sizeof(*samples) * sample_size);
+
+  printf("%-8s %8s %8s %8s %8s %8s\n", "mode", "rate[Hz]", "samples",
+         "p50[us]", "p99[us]", "max[us]");
+  for (int mode = k115200; mode <= k3M; ++mode) {
+    if (!modes[mode])
+      continue;
+    for (int i = 0; i < rate_size; ++i)
+      measure(rates[i], mode);
+  }
+  free(samples);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,187 @@
+// Copyright 2023 Takashi Toyoshima <toyoshim@gmail.com>.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#define _GNU_SOURCE
+
+#include "link.h"
+
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "jvsio_common.h"
+#include "jvsio_host.h"
+
+struct Shared {
+  volatile uint64_t sense_ready_time;  // 0 while the sense is not ready.
+  volatile uint32_t sense_delay;
+};
+
+// Time to transfer a byte in nsec for each JVSIO_CommSupMode.
+static const uint64_t byte_time[] = {86806, 10000, 3333};
+
+static struct Shared* shared;
+static int fds[2];
+static int fd;
+static enum Link_Role role;
+static enum JVSIO_CommSupMode mode;
+static uint64_t line_free;
+static uint8_t rx_buffer[256];
+static size_t rx_size;
+static size_t rx_read;
+static bool mode_changed;
+
+void Link_init(void) {
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds)) {
+    perror("socketpair");
+    exit(EXIT_FAILURE);
+  }
+  shared = Link_allocateShared(sizeof(*shared));
+}
+
+void Link_setRole(enum Link_Role new_role) {
+  role = new_role;
+  fd = fds[role == kLinkHost ? 0 : 1];
+  close(fds[role == kLinkHost ? 1 : 0]);
+  mode = k115200;
+  line_free = 0;
+  rx_size = 0;
+  rx_read = 0;
+}
+
+void Link_close(void) {
+  close(fd);
+}
+
+void Link_setMode(enum JVSIO_CommSupMode new_mode) {
+  mode = new_mode;
+}
+
+void Link_changeMode(enum JVSIO_CommSupMode new_mode) {
+  if (new_mode == mode)
+    return;
+  uint8_t command[] = {kCmdCommChg, new_mode};
+  mode_changed = false;
+  JVSIO_Host_submit(kBroadcastAddress, command, sizeof(command), 0,
+                    JVSIO_Client_getTick() + 100);
+  while (!mode_changed)
+    JVSIO_Host_run();
+  Link_setMode(new_mode);
+  JVSIO_Host_setCommSupMode(new_mode);
+}
+
+void* Link_allocateShared(size_t size) {
+  void* memory = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (memory == MAP_FAILED) {
+    perror("mmap");
+    exit(EXIT_FAILURE);
+  }
+  return memory;
+}
+
+void Link_setSenseDelay(uint32_t usec) {
+  shared->sense_delay = usec;
+}
+
+uint64_t Link_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+void Link_spin(uint64_t nsec) {
+  uint64_t end = Link_now() + nsec;
+  while (Link_now() < end)
+    sched_yield();
+}
+
+int JVSIO_Client_isDataAvailable(void) {
+  if (rx_read < rx_size)
+    return 1;
+  ssize_t size = recv(fd, rx_buffer, sizeof(rx_buffer), MSG_DONTWAIT);
+  if (size == 0) {
+    // The other side has finished.
+    exit(EXIT_SUCCESS);
+  }
+  if (size < 0) {
+    // Let the other side run on machines with fewer cores.
+    sched_yield();
+    return 0;
+  }
+  rx_size = size;
+  rx_read = 0;
+  return 1;
+}
+
+void JVSIO_Client_willSend(void) {}
+
+void JVSIO_Client_willReceive(void) {}
+
+void JVSIO_Client_send(uint8_t data) {
+  // Deliver each byte when its last bit would arrive on the real bus.
+  uint64_t now = Link_now();
+  if (line_free < now)
+    line_free = now;
+  line_free += byte_time[mode];
+  while (Link_now() < line_free)
+    sched_yield();
+  if (write(fd, &data, 1) != 1) {
+    perror("write");
+    exit(EXIT_FAILURE);
+  }
+}
+
+uint8_t JVSIO_Client_receive(void) {
+  return rx_buffer[rx_read++];
+}
+
+bool JVSIO_Client_isSenseReady(void) {
+  // Emulated nodes are at the end of the chain.
+  if (role == kLinkNode)
+    return true;
+  uint64_t ready = shared->sense_ready_time;
+  return ready && Link_now() >= ready;
+}
+
+bool JVSIO_Client_isSenseConnected(void) {
+  return true;
+}
+
+uint32_t JVSIO_Client_getTick(void) {
+  return Link_now() / 1000000u;
+}
+
+uint32_t JVSIO_Client_getMicroseconds(void) {
+  return Link_now() / 1000u;
+}
+
+bool JVSIO_Client_setCommSupMode(enum JVSIO_CommSupMode new_mode,
+                                 bool dryrun) {
+  if (!dryrun)
+    Link_setMode(new_mode);
+  return true;
+}
+
+void JVSIO_Client_setSense(bool ready) {
+  shared->sense_ready_time =
+      ready ? Link_now() + shared->sense_delay * 1000u : 0;
+}
+
+void JVSIO_Client_setLed(bool ready) {}
+
+void JVSIO_Client_delayMicroseconds(unsigned int usec) {
+  Link_spin(usec * 1000u);
+}
+
+void JVSIO_Client_transactionCompleted(uint8_t id,
+                                       uint8_t* status,
+                                       uint8_t len) {
+  // Broadcast CommChg may be answered, or may time out.
+  mode_changed = true;
+}
@@ -0,0 +1,50 @@
+// Copyright 2023 Takashi Toyoshima <toyoshim@gmail.com>.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#if !defined(__LINK_H__)
+#define __LINK_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "jvsio_client.h"
+
+// Emulates a JVS bus between a host process and a node process over a
+// socketpair. Each byte is paced at the bus speed of the current mode, and
+// the sense line is shared via a shared memory.
+// Tools call Link_init() before fork(), and Link_setRole() in each process.
+// Common client APIs are implemented in link.c, and tools implement
+// JVSIO_Client_dump() and ones that are specific for hosts or nodes.
+
+enum Link_Role {
+  kLinkHost,
+  kLinkNode,
+};
+
+void Link_init(void);
+void Link_setRole(enum Link_Role role);
+
+// Closes the link. The process on the other side exits on reading it.
+void Link_close(void);
+
+// Sets the pace of bytes that this process sends.
+void Link_setMode(enum JVSIO_CommSupMode mode);
+
+// Switches the host and all nodes to `mode` by a broadcast CommChg. The host
+// should be ready.
+void Link_changeMode(enum JVSIO_CommSupMode mode);
+
+// Allocates a memory that is shared between processes forked later.
+void* Link_allocateShared(size_t size);
+
+// Sets a delay in usec that the sense line takes to be ready after the node
+// sets it.
+void Link_setSenseDelay(uint32_t usec);
+
+// Monotonic clock in nsec that is shared between processes.
+uint64_t Link_now(void);
+void Link_spin(uint64_t nsec);
+
+#endif  // !defined(__LINK_H__)